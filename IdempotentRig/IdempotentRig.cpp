@@ -24,58 +24,300 @@ coefficients for the 7 monomials.
 We will sometimes work with 7-tuples of integers, and sometimes with single-integer
 indices from 0 to 4^7-1.
 
+Any other finite monoid of up to 8 monomials can be loaded from a file with --monoid, in
+which case there are nmono coefficients and 4^nmono indices.  With --coeffs=K,P the
+coefficients instead follow the rule c = c-P for c >= K+P, with K+P values and (K+P)^nmono
+indices; the rule above is K = P = 2.  Larger monoids, of up to 64 monomials, or rules with
+too many indices, go to a sparse engine that packs the tuples into wider words and only
+stores the classes that it enumerates.  With --derive-coeffs the closure starts from a finer
+rule and reports the collapse of the integers that it finds, which checks the rule above.
+
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <time.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <type_traits>
+#include <new>
+
+#include "RigFile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
 
 #define OUTPUT_FILE "IdempotentRig.txt"
+#define TABLE_CACHE_FILE "IdempotentRig.mtab"
+#define CHECKPOINT_FILE "IdempotentRig.ckpt"
+#define TABLES_FILE "IdempotentRigTables.txt"
+#define RIG_FILE "IdempotentRig.rig"
+
+//	The monoid of monomials has at most MAXMONO elements, so that an index fits in 16 bits.
+//	Monoids of up to MAXSPARSEMONO elements can be loaded, but only the sparse engine, which
+//	packs formal elements into wider words, can handle those with more than MAXMONO.
 
-#define NMONO 7
-#define NINDEX (1<<(2*NMONO))
+#define MAXMONO 8
+#define MAXINDEX (1 << (2*MAXMONO))
+#define MAXSPARSEMONO 64
+static_assert(MAXMONO<=RIG_FILE_MAXMONO,"the rig file loader must accept all the rigs written");
 typedef uint16_t Index;
 
-//	Multiplication table between monomials
+//	Number of monomials, and of formal elements: the nvalue^nmono tuples of coefficients
+
+int nmono;
+int nindex;
+
+//	The coefficients are the natural numbers truncated at coeffK with period coeffP: c is
+//	identified with c-coeffP once c-coeffP >= coeffK, leaving nvalue = coeffK+coeffP values.
+//	The default, 4 = 2, has coeffK = coeffP = 2; then each coefficient takes exactly 2 bits,
+//	and the bit-level kernels (addIndices, multIndices, the slices and AVX2) apply.  Any other
+//	rule uses the tuple arithmetic, or the compiled kernels of Rig<> when they have the rule.
+
+int coeffK = 2, coeffP = 2, nvalue = 4;
+bool twoBitCoeffs = true;
+
+//	An index is its tuple of coefficients as a number in base nvalue, so monomial m has the
+//	index nvalue^m; with 4 values, that is 2 bits per coefficient.
+
+Index monoIndex[MAXMONO];
+
+//	Multiplication table between monomials, with monomial 0 the identity, and text
+//	descriptions for the monomials.  These are the free idempotent monoid on two generators,
+//	unless another monoid is chosen from those built in below or loaded from a file.
+
+int mtab[MAXSPARSEMONO][MAXSPARSEMONO];
+char mtext[MAXSPARSEMONO][RIG_NAME_LEN];
+
+//	The monoids built into the program.  Their tables are constexpr, so that the kernels of
+//	Rig<> can be compiled for each of them.
+
+struct Band2Monoid			//	the free idempotent monoid on a, b
+{
+static constexpr int n = 7;
+static constexpr int tab[7][7] =
+	{
+	{0,1,2,3,4,5,6},
+	{1,1,3,3,5,5,3},
+	{2,4,2,6,4,4,6},
+	{3,5,3,3,5,5,3},
+	{4,4,6,6,4,4,6},
+	{5,5,3,3,5,5,3},
+	{6,4,6,6,4,4,6}
+	};
+static constexpr const char *text[7] = {"1", "a", "b", "ab", "ba", "aba", "bab"};
+};
+
+struct Semilattice2Monoid	//	the free commutative idempotent monoid on a, b
+{
+static constexpr int n = 4;
+static constexpr int tab[4][4] =
+	{
+	{0,1,2,3},
+	{1,1,3,3},
+	{2,3,2,3},
+	{3,3,3,3}
+	};
+static constexpr const char *text[4] = {"1", "a", "b", "ab"};
+};
 
-int mtab[][NMONO] =
+struct LeftRegular2Monoid	//	the free idempotent monoid on a, b with xyx = xy
 {
-{0,1,2,3,4,5,6},
-{1,1,3,3,5,5,3},
-{2,4,2,6,4,4,6},
-{3,5,3,3,5,5,3},
-{4,4,6,6,4,4,6},
-{5,5,3,3,5,5,3},
-{6,4,6,6,4,4,6}
+static constexpr int n = 5;
+static constexpr int tab[5][5] =
+	{
+	{0,1,2,3,4},
+	{1,1,3,3,3},
+	{2,4,2,4,4},
+	{3,3,3,3,3},
+	{4,4,4,4,4}
+	};
+static constexpr const char *text[5] = {"1", "a", "b", "ab", "ba"};
 };
 
-Index MTAB[NINDEX][NINDEX];
-Index ATAB[NINDEX][NINDEX];
+constexpr int Band2Monoid::tab[7][7];
+constexpr const char *Band2Monoid::text[7];
+constexpr int Semilattice2Monoid::tab[4][4];
+constexpr const char *Semilattice2Monoid::text[4];
+constexpr int LeftRegular2Monoid::tab[5][5];
+constexpr const char *LeftRegular2Monoid::text[5];
+
+//	Check that monomial 0 is the identity and that multiplication is associative
+
+bool checkMonoid()
+{
+for (int i=0;i<nmono;i++)
+	if (mtab[0][i]!=i || mtab[i][0]!=i)
+		{
+		printf("Monomial %s is not the identity: %s*%s = %s, %s*%s = %s\n",mtext[0],
+			mtext[0],mtext[i],mtext[mtab[0][i]],mtext[i],mtext[0],mtext[mtab[i][0]]);
+		return false;
+		};
+for (int i=0;i<nmono;i++)
+for (int j=0;j<nmono;j++)
+for (int k=0;k<nmono;k++)
+	if (mtab[mtab[i][j]][k]!=mtab[i][mtab[j][k]])
+		{
+		printf("Multiplication is not associative: (%s*%s)*%s = %s, but %s*(%s*%s) = %s\n",
+			mtext[i],mtext[j],mtext[k],mtext[mtab[mtab[i][j]][k]],
+			mtext[i],mtext[j],mtext[k],mtext[mtab[i][mtab[j][k]]]);
+		return false;
+		};
+return true;
+}
+
+//	Read a monoid from a text file.  Anything after # on a line is ignored.  The first line
+//	lists the names of the monomials, starting with the identity 1; the others must be
+//	distinct strings of letters.  Then comes one line for each monomial, in the same order,
+//	giving its name followed by its products on the right with each monomial in turn:
+//
+//		1	a	b	ab
+//		1	1	a	b	ab
+//		a	a	a	ab	ab
+//		...
+
+bool loadMonoid(const char *path)
+{
+FILE *fp = fopen(path,"r");
+if (fp==NULL)
+	{
+	printf("Unable to open monoid file %s\n",path);
+	return false;
+	};
+	
+char line[4096];
+int row = -1, lineNo = 0;
+bool ok = true;
+nmono = 0;
+while (ok && fgets(line,sizeof(line),fp)!=NULL)
+	{
+	lineNo++;
+	char *hash = strchr(line,'#');
+	if (hash!=NULL) *hash = 0;
+	const char *tok[MAXSPARSEMONO+2];
+	int ntok = 0;
+	for (char *t=strtok(line," \t\r\n");t!=NULL;t=strtok(NULL," \t\r\n"))
+		{
+		if (ntok==MAXSPARSEMONO+2) break;
+		tok[ntok++] = t;
+		};
+	if (ntok==0) continue;
+	
+	if (row<0)
+		{
+		if (ntok>MAXSPARSEMONO)
+			{
+			printf("%s line %d: more than %d monomials\n",path,lineNo,MAXSPARSEMONO);
+			ok = false;
+			break;
+			};
+		if (strcmp(tok[0],"1")!=0)
+			{
+			printf("%s line %d: the first monomial must be the identity, 1\n",path,lineNo);
+			ok = false;
+			break;
+			};
+		for (int i=0;ok && i<ntok;i++)
+			{
+			size_t len = strlen(tok[i]);
+			bool letters = len<RIG_NAME_LEN;
+			for (size_t c=0;c<len;c++)
+				if (!((tok[i][c]>='a' && tok[i][c]<='z') || (tok[i][c]>='A' && tok[i][c]<='Z'))) letters = false;
+			for (int j=0;j<i;j++) if (strcmp(tok[i],tok[j])==0) letters = false;
+			if (i>0 && !letters)
+				{
+				printf("%s line %d: bad or repeated monomial name %s\n",path,lineNo,tok[i]);
+				ok = false;
+				};
+			snprintf(mtext[i],sizeof(mtext[i]),"%s",tok[i]);
+			};
+		nmono = ntok;
+		row = 0;
+		continue;
+		};
+		
+	if (row>=nmono || ntok!=nmono+1 || strcmp(tok[0],mtext[row])!=0)
+		{
+		printf("%s line %d: expected %s followed by %d products\n",path,lineNo,
+			row<nmono ? mtext[row] : "nothing",nmono);
+		ok = false;
+		break;
+		};
+	for (int j=0;ok && j<nmono;j++)
+		{
+		int m = -1;
+		for (int k=0;k<nmono;k++) if (strcmp(tok[j+1],mtext[k])==0) m = k;
+		if (m<0)
+			{
+			printf("%s line %d: unknown monomial %s\n",path,lineNo,tok[j+1]);
+			ok = false;
+			};
+		mtab[row][j] = m;
+		};
+	row++;
+	};
+fclose(fp);
+
+if (ok && row<nmono)
+	{
+	printf("%s: expected %d rows of products, found %d\n",path,nmono,std::max(row,0));
+	ok = false;
+	};
+return ok && checkMonoid();
+}
+
+//	The multiplication table, nindex x nindex, is either built in memory, or mapped from the
+//	table cache
 
-//	Text descriptions for the monomials
+Index *MTAB;
 
-const char *mtext[] = {"1", "a", "b", "ab", "ba", "aba", "bab"};
+inline Index *mtabRow(Index x1)
+{
+return MTAB + (size_t)x1*nindex;
+}
 
-//	Convert an integer 7-tuple to a single index
+//	Convert an integer tuple to a single index
 
 Index tupleToIndex(int *tuple)
 {
 Index res=0;
-for (int i=0;i<NMONO;i++)
+if (twoBitCoeffs) for (int i=0;i<nmono;i++)
 	{
 	res |= tuple[i] << (2*i);
+	}
+else for (int i=nmono-1;i>=0;i--)
+	{
+	res = (Index)(res*nvalue + tuple[i]);
 	};
 return res;
 }
 
-//	Convert an index to an integer 7-tuple
+//	Convert an index to an integer tuple
 
 void indexToTuple(Index index, int *tuple)
 {
-for (int i=0;i<NMONO;i++)
+if (twoBitCoeffs) for (int i=0;i<nmono;i++)
 	{
 	tuple[i] = (index >> (2*i)) & 0x3;
+	}
+else for (int i=0;i<nmono;i++)
+	{
+	tuple[i] = index % nvalue;
+	index /= nvalue;
 	};
 }
 
@@ -85,7 +327,7 @@ void printTuple(FILE *fp, int *tuple, bool par)
 {
 if (par) fprintf(fp,"(");
 bool needPlus=false;
-for (int k=0;k<NMONO;k++)
+for (int k=0;k<nmono;k++)
 if (tuple[k]!=0)
 	{
 	if (needPlus) fprintf(fp,"+");
@@ -105,7 +347,7 @@ if (par) fprintf(fp,")");
 
 void printIndex(FILE *fp, Index index, bool par)
 {
-int tuple[NMONO];
+int tuple[MAXMONO];
 indexToTuple(index,tuple);
 printTuple(fp,tuple,par);
 }
@@ -114,28 +356,28 @@ printTuple(fp,tuple,par);
 
 int normCoeff(int c)
 {
-if (c>=4) return 2+(c%2); else return c;
+if (c>=nvalue) return coeffK+(c-coeffK)%coeffP; else return c;
 }
 
 //	Multiply two tuples
 
 void multTuples(int *t1, int *t2, int *t12)
 {
-for (int i=0;i<NMONO;i++) t12[i]=0;
+for (int i=0;i<nmono;i++) t12[i]=0;
 
-for (int i=0;i<NMONO;i++)
+for (int i=0;i<nmono;i++)
 if (t1[i]!=0)
-for (int j=0;j<NMONO;j++)
+for (int j=0;j<nmono;j++)
 	t12[mtab[i][j]] += t1[i]*t2[j];
 	
-for (int i=0;i<NMONO;i++) t12[i]=normCoeff(t12[i]);
+for (int i=0;i<nmono;i++) t12[i]=normCoeff(t12[i]);
 }
 
-//	Multiply two indices
+//	Multiply two indices, via tuples
 
-Index multIndices(Index i1, Index i2)
+Index multIndicesByTuples(Index i1, Index i2)
 {
-int t1[NMONO], t2[NMONO], t12[NMONO];
+int t1[MAXMONO], t2[MAXMONO], t12[MAXMONO];
 indexToTuple(i1,t1);
 indexToTuple(i2,t2);
 multTuples(t1,t2,t12);
@@ -146,410 +388,3912 @@ return tupleToIndex(t12);
 
 void addTuples(int *t1, int *t2, int *t12)
 {
-for (int i=0;i<NMONO;i++) t12[i]=normCoeff(t1[i]+t2[i]);
+for (int i=0;i<nmono;i++) t12[i]=normCoeff(t1[i]+t2[i]);
 }
 
-//	Add two indices
+//	Add two indices, via tuples
 
-Index addIndices(Index i1, Index i2)
+Index addIndicesByTuples(Index i1, Index i2)
 {
-int t1[NMONO], t2[NMONO], t12[NMONO];
+int t1[MAXMONO], t2[MAXMONO], t12[MAXMONO];
 indexToTuple(i1,t1);
 indexToTuple(i2,t2);
 addTuples(t1,t2,t12);
 return tupleToIndex(t12);
 }
 
-//	Linked list node
+//	Sums for other coefficient rules.  Addition is digitwise, so the sum of two indices is
+//	put together from the sums of their low halves, the first few digits, and of their high
+//	halves, each looked up in a table of all pairs of halves.  HALFLO and HALFHI give the
+//	halves of every index, to save dividing, and the high sums are stored shifted into place.
 
-struct node
-{
-int prev, next;
-int count;
-Index *elements;
-};
+int addLo, addHi;
+Index *HALFLO, *HALFHI;
+Index *ADDLO, *ADDHI;
 
-//	Linked list of equivalence classes of elements
+#define MAX_ADD_HALF 4096
 
-struct node LL[NINDEX];
-int firstLL, countLL;
+void setupAddTables()
+{
+if (twoBitCoeffs) return;
+addLo = addHi = 1;
+for (int m=0;m<nmono;m++)
+	{
+	if (m<(nmono+1)/2) addLo *= nvalue;
+	else addHi *= nvalue;
+	};
+if (addLo>MAX_ADD_HALF) return;
+HALFLO = new Index[nindex];
+HALFHI = new Index[nindex];
+for (int x=0;x<nindex;x++)
+	{
+	HALFLO[x] = x%addLo;
+	HALFHI[x] = x/addLo;
+	};
+ADDLO = new Index[addLo*addLo];
+ADDHI = new Index[addHi*addHi];
+for (int x=0;x<addLo;x++)
+for (int y=0;y<addLo;y++)
+	ADDLO[x*addLo+y] = addIndicesByTuples(x,y);
+for (int x=0;x<addHi;x++)
+for (int y=0;y<addHi;y++)
+	ADDHI[x*addHi+y] = addIndicesByTuples(x*addLo,y*addLo);
+}
 
-//	Equivalence class index for each element
+inline Index addIndicesSplit(Index i1, Index i2)
+{
+if (ADDLO==NULL) return addIndicesByTuples(i1,i2);
+return (Index)(ADDLO[HALFLO[i1]*addLo+HALFLO[i2]] + ADDHI[HALFHI[i1]*addHi+HALFHI[i2]]);
+}
 
-Index eqc[NINDEX];
+//	Add two indices, working on all the 2-bit coefficients at once.
+//
+//	For each coefficient, with a = 2*a1+a0 and b = 2*b1+b0, the normalised sum has low bit
+//	a0^b0 whether or not the sum reaches 4 (since 4=2, 5=3, 6=2), and high bit set if the
+//	true sum has its 2s bit set or carries into the 4s bit, which happens exactly when any of
+//	a1, b1 or a0&b0 is set.
 
-//	Sort equivalence classes by size
+#define LOBITS ((Index)(0x5555 & (nindex-1)))
+#define HIBITS ((Index)(LOBITS << 1))
 
-int ecmp(const void *a, const void *b)
+inline Index addIndices(Index i1, Index i2)
 {
-int e1 = *((int *)(a));
-int e2 = *((int *)(b));
-int s1 = LL[e1].count;
-int s2 = LL[e2].count;
-return s1-s2;
+if (!twoBitCoeffs) return addIndicesSplit(i1,i2);
+return (Index)(((i1 ^ i2) & LOBITS) | ((i1 | i2 | ((i1 & i2 & LOBITS) << 1)) & HIBITS));
 }
 
-//	Sort equivalence classes by first element
+//	Multiply every coefficient of an index by c, from 0 to 3.
+//
+//	2a is 2 whenever a is non-zero, and 3a = a+2a has the low bit of a and the high bit of 2a.
 
-int ecmpFE(const void *a, const void *b)
+inline Index scaleIndex(Index i, int c)
 {
-int e1 = *((int *)(a));
-int e2 = *((int *)(b));
-int s1 = (int)(LL[e1].elements[0]);
-int s2 = (int)(LL[e2].elements[0]);
-return s1-s2;
+Index twice = (Index)(((i | (i >> 1)) & LOBITS) << 1);
+Index m0 = (Index)(-(c & 1));
+Index m1 = (Index)(-(c >> 1));
+return (Index)((twice & m1) | (i & m0 & ~(m1 & HIBITS)));
 }
 
-//	Sort Index type
+//	Products of each monomial with every index.  This is nmono*nindex entries, small enough to
+//	stay in L2 cache.  For other coefficient rules, MACT[i][c*nindex+y] is c times the product,
+//	for each coefficient c, unless that would be too large.  MACTR holds the products the other
+//	way round, y*m_i, for building columns of the multiplication table.
+
+Index *MACT[MAXMONO];
+Index *MACTR[MAXMONO];
+bool scaledActions = false;
+bool avx2Rows = false;		//	whether multRowAVX2 can be used
+
+#define MAX_SCALED_ACTIONS (1 << 24)
+
+void setupActions(Index **act, bool right)
+{
+int scales = scaledActions ? nvalue : 1;
+for (int i=0;i<nmono;i++) act[i] = new Index[(size_t)scales*nindex];
+for (int i=0;i<nmono;i++)
+for (int y=0;y<nindex;y++)
+	act[i][y] = right ? multIndicesByTuples(y,monoIndex[i]) : multIndicesByTuples(monoIndex[i],y);
+if (scaledActions)
+for (int i=0;i<nmono;i++)
+for (int y=0;y<nindex;y++)
+	{
+	Index v = act[i][y];
+	act[i][y] = 0;
+	for (int c=1;c<nvalue;c++) act[i][(size_t)c*nindex+y] = addIndices(act[i][(size_t)(c-1)*nindex+y],v);
+	};
+}
 
-int cmpIndex(const void *a, const void *b)
+void setupMonomialActions()
 {
-int e1 = (int)(*((Index *)(a)));
-int e2 = (int)(*((Index *)(b)));
-return e1-e2;
+scaledActions = !twoBitCoeffs && (size_t)nmono*nvalue*nindex <= MAX_SCALED_ACTIONS;
+setupActions(MACT,false);
+setupActions(MACTR,true);
+#ifdef HAVE_AVX2_KERNEL
+avx2Rows = __builtin_cpu_supports("avx2") && nindex>=16 && twoBitCoeffs;
+#endif
 }
 
-//	Sort each equivalence class, and output both the minimum element of each class,
-//	and all the classes.
+//	The compiled product for the monoid and coefficient rule, set by selectKernels when it is
+//	faster than the lookups below
+
+Index (*compiledMult)(Index, Index) = NULL;
 
-void outputEC(FILE *fp)
+//	Multiply two indices, factorized over the monomials of i1: since multiplication is bilinear,
+//	i1*i2 is the sum over monomials m_k of c_k*(m_k*i2), where c_k is the coefficient of m_k
+//	in i1.  Writing c_k*v = (c_k&1)*v + (c_k>>1)*2v, and noting that a sum of terms 2v only
+//	depends on which coefficients are non-zero, the second part needs just an OR of the v's.
+
+inline Index multIndices(Index i1, Index i2)
 {
-int *cnum = new int[countLL];
-int nc=0;
-int ePtr = firstLL;
-while (ePtr>=0)
+if (!twoBitCoeffs)
+	{
+	if (compiledMult!=NULL) return compiledMult(i1,i2);
+	if (!scaledActions) return multIndicesByTuples(i1,i2);
+	Index r = 0;
+	for (int k=0;k<nmono;k++,i1/=nvalue) r = addIndices(r,MACT[k][(size_t)(i1%nvalue)*nindex+i2]);
+	return r;
+	};
+Index odd = 0, even = 0;
+for (int k=0;k<nmono;k++)
 	{
-	qsort(LL[ePtr].elements,LL[ePtr].count,sizeof(LL[ePtr].elements[0]),cmpIndex);
-	cnum[nc++] = ePtr;
-	ePtr = LL[ePtr].next;
+	Index v = MACT[k][i2];
+	odd = addIndices(odd,v & (Index)(-((i1 >> (2*k)) & 1)));
+	even |= v & (Index)(-((i1 >> (2*k+1)) & 1));
 	};
-qsort(cnum,nc,sizeof(cnum[0]),ecmpFE);
+return addIndices(odd,scaleIndex(even,2));
+}
 
-//	Output minimum element of each class
+//	Multiply two indices, looking the result up in MTAB unless it was not built
 
-fprintf(fp,"{");
-for (int i=0;i<countLL;i++)
+bool haveMTAB = true;
+
+//	Largest MTAB we will build; beyond this (8 monomials, 8 GB) use multIndices
+
+#define MAX_MTAB_BYTES ((size_t)1 << 30)
+
+inline Index multiply(Index i1, Index i2)
+{
+return haveMTAB ? mtabRow(i1)[i2] : multIndices(i1,i2);
+}
+
+//	Bit-sliced arithmetic on 64 elements at once.
+//
+//	Bit k of lo[i] and hi[i] holds the low and high bits of the coefficient of monomial i in
+//	element k, so the rules for single coefficients apply to all 64 at once with bitwise logic
+//	on whole planes.  Sums follow addIndices.  A product of coefficients a*b has low bit a0&b0,
+//	and high bit set when it is at least 2, i.e. when one factor is at least 2 and the other
+//	non-zero; since 2*2 = 4 = 2, 2*3 = 6 = 2 and 3*3 = 9 = 3, those bits are already normalised.
+
+struct Slice
+{
+uint64_t lo[MAXMONO], hi[MAXMONO];
+};
+
+//	Transpose an 8x8 matrix of bits, held as eight bytes (Hacker's Delight, 7-3)
+
+inline uint64_t transpose8(uint64_t x)
+{
+x = (x & 0xAA55AA55AA55AA55ULL) | ((x & 0x00AA00AA00AA00AAULL) << 7) | ((x >> 7) & 0x00AA00AA00AA00AAULL);
+x = (x & 0xCCCC3333CCCC3333ULL) | ((x & 0x0000CCCC0000CCCCULL) << 14) | ((x >> 14) & 0x0000CCCC0000CCCCULL);
+x = (x & 0xF0F0F0F00F0F0F0FULL) | ((x & 0x00000000F0F0F0F0ULL) << 28) | ((x >> 28) & 0x00000000F0F0F0F0ULL);
+return x;
+}
+
+//	Load 64 indices into a slice, and store them back.  Each group of 8 indices is split into
+//	its low and high bytes, and each 8x8 block transposed to give a byte of 8 bit planes.
+
+void sliceLoad(Slice &s, const Index *x)
+{
+uint64_t plane[16];
+for (int b=0;b<16;b++) plane[b] = 0;
+for (int g=0;g<8;g++)
 	{
-	ePtr = cnum[i];
-	if (i!=0) fprintf(fp,",\n");
-	printIndex(fp,LL[ePtr].elements[0],false);
+	uint64_t low = 0, high = 0;
+	for (int r=0;r<8;r++)
+		{
+		low |= (uint64_t)(x[8*g+r] & 0xFF) << (8*r);
+		high |= (uint64_t)(x[8*g+r] >> 8) << (8*r);
+		};
+	low = transpose8(low);
+	high = transpose8(high);
+	for (int c=0;c<8;c++)
+		{
+		plane[c] |= ((low >> (8*c)) & 0xFF) << (8*g);
+		plane[8+c] |= ((high >> (8*c)) & 0xFF) << (8*g);
+		};
 	};
-fprintf(fp,"}\n\n");
-
-//	Output all elements of each class
+for (int i=0;i<nmono;i++)
+	{
+	s.lo[i] = plane[2*i];
+	s.hi[i] = plane[2*i+1];
+	};
+}
 
-fprintf(fp,"{");
-for (int i=0;i<countLL;i++)
+void sliceStore(const Slice &s, Index *x)
+{
+uint64_t plane[16];
+for (int i=0;i<8;i++) plane[2*i] = plane[2*i+1] = 0;
+for (int i=0;i<nmono;i++)
 	{
-	ePtr = cnum[i];
-	if (i!=0) fprintf(fp,",\n");
-	fprintf(fp,"{");
-	for (int j=0;j<LL[ePtr].count;j++)
+	plane[2*i] = s.lo[i];
+	plane[2*i+1] = s.hi[i];
+	};
+for (int g=0;g<8;g++)
+	{
+	uint64_t low = 0, high = 0;
+	for (int c=0;c<8;c++)
 		{
-		if (j!=0) fprintf(fp,", ");
-		printIndex(fp,LL[ePtr].elements[j],false);
+		low |= ((plane[c] >> (8*g)) & 0xFF) << (8*c);
+		high |= ((plane[8+c] >> (8*g)) & 0xFF) << (8*c);
 		};
-	fprintf(fp,"}");
+	low = transpose8(low);
+	high = transpose8(high);
+	for (int r=0;r<8;r++) x[8*g+r] = (Index)(((low >> (8*r)) & 0xFF) | (((high >> (8*r)) & 0xFF) << 8));
 	};
-fprintf(fp,"}\n");
+}
 
-delete [] cnum;
+//	Load the same index into all 64 lanes, or the 64 consecutive indices from base, a multiple
+//	of 64; for the latter the planes of the lowest six bits are fixed patterns.
+
+void sliceBroadcast(Slice &s, Index x)
+{
+for (int i=0;i<nmono;i++)
+	{
+	s.lo[i] = -(uint64_t)((x >> (2*i)) & 1);
+	s.hi[i] = -(uint64_t)((x >> (2*i+1)) & 1);
+	};
 }
 
-int main(int argc, const char * argv[])
+void sliceRange(Slice &s, Index base)
 {
-//	Print the monomial multiplication table
+static const uint64_t pattern[6] =
+	{
+	0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+	0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+	};
+sliceBroadcast(s,base);
+for (int b=0;b<6;b++)
+	{
+	if (b & 1) s.hi[b/2] = pattern[b];
+	else s.lo[b/2] = pattern[b];
+	};
+}
 
-printf("Monomial multiplication table\n     ");
-for (int i=0;i<NMONO;i++) printf("%5s",mtext[i]);
-printf("\n     ");
-for (int i=0;i<NMONO;i++) printf("  ===");
-printf("\n");
-for (int i=0;i<NMONO;i++)
+void sliceAdd(const Slice &a, const Slice &b, Slice &r)
+{
+for (int i=0;i<nmono;i++)
 	{
-	printf("%4s|",mtext[i]);
-	for (int j=0;j<NMONO;j++) printf("%5s",mtext[mtab[i][j]]);
-	printf("\n");
+	uint64_t lo = a.lo[i] ^ b.lo[i];
+	r.hi[i] = a.hi[i] | b.hi[i] | (a.lo[i] & b.lo[i]);
+	r.lo[i] = lo;
 	};
-printf("\n");
+}
 
-printf("Checking indexToTuple/tupleToIndex ...\n");
-int tup[NMONO];
-for (Index k=0;k<NINDEX;k++)
+void sliceMult(const Slice &a, const Slice &b, Slice &r)
+{
+Slice t;
+for (int k=0;k<nmono;k++) t.lo[k] = t.hi[k] = 0;
+for (int i=0;i<nmono;i++)
 	{
-	indexToTuple(k,tup);
-	if (k!=tupleToIndex(tup))
+	uint64_t anz = a.lo[i] | a.hi[i];
+	for (int j=0;j<nmono;j++)
 		{
-		printf("indexToTuple/tupleToIndex failure for index=%d\n",k);
-		break;
+		uint64_t plo = a.lo[i] & b.lo[j];
+		uint64_t phi = (a.hi[i] & (b.lo[j] | b.hi[j])) | (b.hi[j] & anz);
+		int k = mtab[i][j];
+		t.hi[k] |= phi | (t.lo[k] & plo);
+		t.lo[k] ^= plo;
 		};
 	};
-printf("Done\n\n");
+r = t;
+}
 
-printf("First few sums ...\n");
-for (Index k=0;k<20;k++)
+//	Compile-time kernels.
+//
+//	Rig<M,C> is the arithmetic of the formal elements over a built-in monoid M, with the
+//	coefficient rule C, which gives the width of a packed coefficient, the normalisation of a
+//	coefficient and the packed sum.  All the loops have compile-time bounds and are unrolled
+//	by Unroll<>, so the monoid table never has to be read: it only appears as constant shifts
+//	in the generated code.  Unroll<N>::run(f) calls f(I) for I = 0 .. N-1 in turn, each I an
+//	std::integral_constant.
+
+template <int N> struct Unroll
+{
+template <typename F> __attribute__((always_inline)) static inline void run(F f)
 	{
-	printIndex(stdout,k,false);
-	printf("\n");
+	Unroll<N-1>::run(f);
+	f(std::integral_constant<int,N-1>());
 	};
-printf("\n\n");
+};
 
-//	Test multiplication
+template <> struct Unroll<0>
+{
+template <typename F> __attribute__((always_inline)) static inline void run(F) {};
+};
 
-int aplusb[]={0,1,1,0,0,0,0};	//	a+b
-int aplusb2[NMONO];
-multTuples(aplusb,aplusb,aplusb2);
-printf("Test multiplication\n");
-printTuple(stdout,aplusb,true);
-printf("^2 = ");
-printTuple(stdout,aplusb2,false);
-printf("\n\n");
+#define UNROLLED(I) decltype(I)::value
 
-//	Set up multiplication and addition tables
+//	The coefficient rules with compiled kernels: 4 = 2 with 2 bits per coefficient, summed as
+//	in addIndices, and Boolean 1+1 = 1 with 1 bit, summed by OR.  lo has the low bit of every
+//	coefficient set.
 
-printf("Creating multiplication and addition tables ...\n");
-for (Index x1=0;x1<NINDEX;x1++)
+struct Coeff4Is2
+{
+static constexpr int K = 2, P = 2, bits = 2;
+static constexpr int norm(int c) { return c>=4 ? 2+(c&1) : c; }
+static inline Index add(Index x, Index y, Index lo)
 	{
-	if (x1 % 100 == 0) printf("x1=%d / %d\n",x1,NINDEX);
-	int t1[NMONO];
-	indexToTuple(x1,t1);
-	for (Index x2=0;x2<NINDEX;x2++)
-		{
-		int t2[NMONO], t12[NMONO];
-		indexToTuple(x2,t2);
-		
-		multTuples(t1,t2,t12);
-		MTAB[x1][x2] = tupleToIndex(t12);
-		
-		addTuples(t1,t2,t12);
-		ATAB[x1][x2] = tupleToIndex(t12);
-		};
+	return (Index)(((x ^ y) & lo) | ((x | y | ((x & y & lo) << 1)) & (lo << 1)));
 	};
-printf("Done\n\n");
+};
+
+struct CoeffBoolean
+{
+static constexpr int K = 1, P = 1, bits = 1;
+static constexpr int norm(int c) { return c>0 ? 1 : 0; }
+static inline Index add(Index x, Index y, Index) { return (Index)(x | y); };
+};
 
-//	Initialise the linked list of equivalent classes
+template <class M, class C> struct Rig
+{
+static constexpr int n = M::n;
+static constexpr int bits = C::bits;
+static constexpr int nindex = 1 << (bits*n);
+static constexpr Index LO = (Index)((nindex-1)/((1 << bits)-1));
+
+static_assert(bits*n<=16,"the packed kernels need a 16-bit index");
 
-firstLL=-1;
-countLL=0;
-for (int k=0;k<NINDEX;k++)
+static inline void toTuple(Index x, int *t)
 	{
-	LL[k].prev = LL[k].next = -1;
-	LL[k].count = 0;
-	LL[k].elements = NULL;
+	Unroll<n>::run([&](auto I){ t[UNROLLED(I)] = (x >> (bits*UNROLLED(I))) & ((1 << bits)-1); });
 	};
 	
-//	Put each of the NINDEX formal elements into an equivalence class based on its square
-//
-//	If x^2 = y^2, then x = x^2 = y^2 = y
-
-for (Index x=0;x<NINDEX;x++)
+static inline Index fromTuple(const int *t)
 	{
-	Index sq = MTAB[x][x];
-	eqc[x] = sq;
-	if (LL[sq].count==0)
-		{
-		LL[sq].count = 1;
-		LL[sq].elements = new Index[NINDEX];
-		LL[sq].elements[0] = x;
-		countLL++;
-		int oldFirst = firstLL;
-		firstLL = sq;
-		LL[sq].prev = -1;
-		LL[sq].next = oldFirst;
-		if (oldFirst >= 0)
-			{
-			LL[oldFirst].prev = sq;
-			};
-		}
-	else
-		{
-		LL[sq].elements[LL[sq].count++] = x;
-		};
+	Index x = 0;
+	Unroll<n>::run([&](auto I){ x |= (Index)(t[UNROLLED(I)] << (bits*UNROLLED(I))); });
+	return x;
 	};
 	
-printf("Initially created %d equivalence classes based on elements having the same square\n",countLL);
-
-//	Modify the equivalence classes, so that x^2 itself is always in the equivalence class labelled by x^2, rather than (x^2)^2 if that is formally different
-
-for (int pass=0;pass<2;pass++)
+static inline void multTuples(const int *t1, const int *t2, int *t12)
 	{
-	int ePtr = firstLL;
-	int ec=0, nic=0, elc=0;
-	while (ePtr >= 0)
+	int acc[n] = {};
+	Unroll<n>::run([&](auto I)
 		{
-		ec++;
-		if (pass==1) elc += LL[ePtr].count;
-		int ecl = eqc[ePtr];
-		if (ecl != ePtr)
+		Unroll<n>::run([&](auto J)
 			{
-			nic++;
-			
-			//	Merge the ecl class into the ePtr class
-			
-			for (int k=0;k<LL[ecl].count;k++)
-				{
-				Index z = LL[ecl].elements[k];
-				LL[ePtr].elements[LL[ePtr].count++] = z;
-				eqc[z] = ePtr;
-				};
-				
-			countLL--;
-			
-			//	Unlink
-			
-			int prev = LL[ecl].prev;
-			int next = LL[ecl].next;
-			if (prev<0) firstLL = next;
-			else LL[prev].next = next;
-			if (next>=0) LL[next].prev = prev;
-			
-			delete [] LL[ecl].elements;
-			LL[ecl].elements = NULL;
-			LL[ecl].count = 0;
-			LL[ecl].prev = LL[ecl].next = -1;
-			};
-			
-		ePtr = LL[ePtr].next;
-		};
-	printf("Equivalence classes checked = %d, those where x^2 not in own class = %d\n",ec,nic);
-	printf("We now have %d equivalence classes\n",countLL);
-	if (pass==1) printf("Total elements counted is %d\n",elc);
+			acc[M::tab[UNROLLED(I)][UNROLLED(J)]] += t1[UNROLLED(I)]*t2[UNROLLED(J)];
+			});
+		});
+	Unroll<n>::run([&](auto K){ t12[UNROLLED(K)] = C::norm(acc[UNROLLED(K)]); });
 	};
 	
-//	Revalidate all equivalence class info
-
-printf("Validating equivalence class info ...\n");
-int ePtr = firstLL;
-int eChk = 0;
-while (ePtr >= 0)
+static inline Index add(Index x, Index y)
+	{
+	return C::add(x,y,LO);
+	};
+	
+//	Single products go through the tuples; these are only used for checking, since
+//	multiply() has MTAB or the MACT lookups of multIndices
+	
+static inline Index mult(Index x, Index y)
 	{
-	for (int k=0;k<LL[ePtr].count;k++)
+	int t1[n], t2[n], t12[n];
+	toTuple(x,t1);
+	toTuple(y,t2);
+	multTuples(t1,t2,t12);
+	return fromTuple(t12);
+	};
+	
+//	Fill row x1 of MTAB, or if right is true column x1.  The product is additive in the other
+//	factor y, so once the products with the monomials m_j are known, the product with y is
+//	the product with y less one m_j, for its lowest non-zero digit j, plus the product with
+//	m_j.  That builds the products with the low digits of y, 0 .. L-1, and with each multiple
+//	of L in turn, and then every other entry is a single packed sum of two of those, in an
+//	inner loop of fixed length L that the compiler can vectorize.
+	
+static void multRow(Index x1, Index *row, bool right)
+	{
+	constexpr int L = 1 << (bits*((n+1)/2));
+	int t1[n];
+	toTuple(x1,t1);
+	Index mono[n];
+	Unroll<n>::run([&](auto J)
 		{
-		if (eqc[LL[ePtr].elements[k]] != ePtr)
-			{
-			printf("Failed\n");
-			exit(EXIT_FAILURE);
-			};
+		int tj[n] = {}, t12[n];
+		tj[UNROLLED(J)] = 1;
+		if (right) multTuples(tj,t1,t12);
+		else multTuples(t1,tj,t12);
+		mono[UNROLLED(J)] = fromTuple(t12);
+		});
+	auto step = [&](int y)
+		{
+		int j = __builtin_ctz(y)/bits;
+		return add(row[y-(1 << (bits*j))],mono[j]);
+		};
+	row[0] = 0;
+	for (int y=1;y<L;y++) row[y] = step(y);
+	for (int base=L;base<nindex;base+=L)
+		{
+		Index rb = step(base);
+		for (int y=0;y<L;y++) row[base+y] = add(row[y],rb);
 		};
-	eChk += LL[ePtr].count;
-	ePtr = LL[ePtr].next;
 	};
-printf("Done, total elements checked = %d\n\n",eChk);
+};
 
-//	We now check pairs of elements that are in the same equivalence class,
-//	x1==x2, y1==y2, and if:
-//
-//	x1*y1 and x2*y2 are not in the same class
-//	x1+y1 and x2+y2 are not in the same class
-//
-//	we merge the associated classes and start again
+//	The kernels for one built-in monoid and coefficient rule
 
-int *cnum = new int[countLL];
+struct RigKernels
+{
+int coeffK, coeffP;
+Index (*mult)(Index, Index);
+Index (*add)(Index, Index);
+void (*multRow)(Index, Index *, bool);
+void (*multTuples)(const int *, const int *, int *);
+};
+
+template <class M, class C> RigKernels rigKernels()
+{
+typedef Rig<M,C> R;
+return {C::K,C::P,R::mult,R::add,R::multRow,R::multTuples};
+}
+
+//	The built-in monoids, with their kernels for each of the rules above.  --monoid=NAME
+//	chooses one by name, and any monoid whose table matches one of these, however it was
+//	given, uses its kernels when --coeffs gives one of the rules.
+
+#define NUM_KERNEL_RULES 2
+
+struct BuiltinMonoid
+{
+const char *name;
+int n;
+const int *tab;
+const char *const *text;
+RigKernels kernels[NUM_KERNEL_RULES];
+};
+
+template <class M> BuiltinMonoid builtinMonoid(const char *name)
+{
+return {name,M::n,&M::tab[0][0],M::text,{rigKernels<M,Coeff4Is2>(),rigKernels<M,CoeffBoolean>()}};
+}
+
+const BuiltinMonoid builtinMonoids[] =
+{
+builtinMonoid<Band2Monoid>("band2"),
+builtinMonoid<Semilattice2Monoid>("semilattice2"),
+builtinMonoid<LeftRegular2Monoid>("leftregular2")
+};
+
+#define NUM_BUILTIN_MONOIDS ((int)(sizeof(builtinMonoids)/sizeof(builtinMonoids[0])))
+
+//	The kernels in use, or NULL if mtab and the coefficient rule are not one of them, and the
+//	name of their monoid
+
+const RigKernels *kernels = NULL;
+const char *kernelMonoid = NULL;
+
+const BuiltinMonoid *findBuiltinMonoid(const char *name)
+{
+for (int b=0;b<NUM_BUILTIN_MONOIDS;b++)
+	if (strcmp(builtinMonoids[b].name,name)==0) return &builtinMonoids[b];
+return NULL;
+}
+
+void setupBuiltinMonoid(const BuiltinMonoid &B)
+{
+nmono = B.n;
+for (int i=0;i<nmono;i++)
+	{
+	snprintf(mtext[i],sizeof(mtext[i]),"%s",B.text[i]);
+	for (int j=0;j<nmono;j++) mtab[i][j] = B.tab[i*nmono+j];
+	};
+}
+
+void selectKernels()
+{
+kernels = NULL;
+for (int b=0;b<NUM_BUILTIN_MONOIDS && kernels==NULL;b++)
+	{
+	const BuiltinMonoid &B = builtinMonoids[b];
+	bool same = B.n==nmono;
+	for (int i=0;same && i<nmono;i++)
+	for (int j=0;j<nmono;j++) if (mtab[i][j]!=B.tab[i*nmono+j]) same = false;
+	for (int r=0;same && r<NUM_KERNEL_RULES;r++)
+	if (B.kernels[r].coeffK==coeffK && B.kernels[r].coeffP==coeffP)
+		{
+		kernels = &B.kernels[r];
+		kernelMonoid = B.name;
+		};
+	};
+
+//	The compiled rows match the AVX2 ones for 4 = 2, and are much faster than the monomial
+//	actions for the other rules, so they are always used.  Single products only beat
+//	multIndices when it has to use the monomial actions.
+
+compiledMult = (kernels!=NULL && !twoBitCoeffs) ? kernels->mult : NULL;
+if (kernels!=NULL)
+	printf("Using the compiled kernels for %s with coefficients %d,%d to fill the rows of the\n"
+		"multiplication table%s\n\n",kernelMonoid,coeffK,coeffP,compiledMult!=NULL ? ", and for single products" : "");
+}
+
+//	Wall-clock time in seconds, for timing comparisons
+
+double wallSeconds()
+{
+struct timespec ts;
+clock_gettime(CLOCK_MONOTONIC,&ts);
+return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+//	Number of worker threads, and a helper that shares out blocks [start,end) of 0..n-1
+//	among them, each thread taking the next unclaimed block as soon as it is free
+
+int numThreads = 1;
+
+template <typename F> void parallelBlocks(int n, int block, F f)
+{
+std::atomic<int> next(0);
+auto worker = [&]()
+	{
+	int start;
+	while ((start = next.fetch_add(block)) < n) f(start,std::min(start+block,n));
+	};
+std::thread *pool = new std::thread[numThreads];
+for (int t=0;t<numThreads;t++) pool[t] = std::thread(worker);
+for (int t=0;t<numThreads;t++) pool[t].join();
+delete [] pool;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+
+//	Fill one row of MTAB, 16 x2 values at a time with AVX2, when the processor has it.  For
+//	fixed x1 the masks in multIndices are constants, so the row is built from whole rows of MACT.
+//	Passing MACTR for act builds column x1 instead.
+
+__attribute__((target("avx2"))) inline __m256i addIndicesAVX2(__m256i a, __m256i b)
+{
+const __m256i lo = _mm256_set1_epi16(LOBITS), hi = _mm256_set1_epi16(HIBITS);
+__m256i carry = _mm256_slli_epi16(_mm256_and_si256(_mm256_and_si256(a,b),lo),1);
+return _mm256_or_si256(_mm256_and_si256(_mm256_xor_si256(a,b),lo),
+	_mm256_and_si256(_mm256_or_si256(_mm256_or_si256(a,b),carry),hi));
+}
+
+__attribute__((target("avx2"))) void multRowAVX2(Index x1, Index *row, Index *const *act)
+{
+__m256i m0[MAXMONO], m1[MAXMONO];
+for (int k=0;k<nmono;k++)
+	{
+	m0[k] = _mm256_set1_epi16((short)(-((x1 >> (2*k)) & 1)));
+	m1[k] = _mm256_set1_epi16((short)(-((x1 >> (2*k+1)) & 1)));
+	};
+const __m256i lo = _mm256_set1_epi16(LOBITS);
+for (int x2=0;x2<nindex;x2+=16)
+	{
+	__m256i odd = _mm256_setzero_si256(), even = _mm256_setzero_si256();
+	for (int k=0;k<nmono;k++)
+		{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(act[k]+x2));
+		odd = addIndicesAVX2(odd,_mm256_and_si256(v,m0[k]));
+		even = _mm256_or_si256(even,_mm256_and_si256(v,m1[k]));
+		};
+	__m256i twice = _mm256_slli_epi16(_mm256_and_si256(_mm256_or_si256(even,_mm256_srli_epi16(even,1)),lo),1);
+	_mm256_storeu_si256((__m256i *)(row+x2),addIndicesAVX2(odd,twice));
+	};
+}
+
+#endif
+
+//	On-disk cache of MTAB.  The file has a page-sized header with a magic string, the format
+//	version, nmono and a hash of everything the table depends on, followed by the table itself,
+//	so that it can be mapped directly and shared through the page cache by concurrent runs.
+
+#define CACHE_MAGIC "IRigMTAB"
+#define CACHE_VERSION 1
+#define CACHE_HEADER 4096
+#define CACHE_SIZE (CACHE_HEADER + sizeof(Index)*nindex*nindex)
+
+struct cacheHeader
+{
+char magic[8];
+uint32_t version, nmono;
+uint64_t nindex, key;
+};
+
+//	FNV-1a hash of nmono, the monomial table and the coefficient rule, which is given by coeffK
+//	and coeffP themselves, since no finite table of normCoeff tells every pair of rules apart
+
+uint64_t tableKey()
+{
+uint64_t h = 14695981039346656037ULL;
+int words[1 + MAXMONO*MAXMONO + 3], nw = 0;
+words[nw++] = nmono;
+for (int i=0;i<nmono;i++)
+for (int j=0;j<nmono;j++)
+	words[nw++] = mtab[i][j];
+words[nw++] = coeffK;
+words[nw++] = coeffP;
+words[nw++] = nvalue;
+for (int k=0;k<nw;k++)
+for (int b=0;b<4;b++)
+	{
+	h ^= (words[k] >> (8*b)) & 0xff;
+	h *= 1099511628211ULL;
+	};
+return h;
+}
+
+//	Map MTAB from the cache file, if it exists and matches the current tables
+
+bool mapMultTable(const char *path)
+{
+int fd = open(path,O_RDONLY);
+if (fd<0) return false;
+struct stat st;
+if (fstat(fd,&st)!=0 || (size_t)st.st_size != CACHE_SIZE)
+	{
+	printf("Table cache %s has the wrong size, rebuilding\n",path);
+	close(fd);
+	return false;
+	};
+void *base = mmap(NULL,CACHE_SIZE,PROT_READ,MAP_SHARED,fd,0);
+close(fd);
+if (base==MAP_FAILED) return false;
+
+const cacheHeader *h = (const cacheHeader *)base;
+if (memcmp(h->magic,CACHE_MAGIC,8)!=0 || h->version!=CACHE_VERSION || h->nmono!=(uint32_t)nmono
+	|| h->nindex!=(uint64_t)nindex || h->key!=tableKey())
+	{
+	printf("Table cache %s is for different tables, rebuilding\n",path);
+	munmap(base,CACHE_SIZE);
+	return false;
+	};
+
+#ifdef MADV_HUGEPAGE
+madvise(base,CACHE_SIZE,MADV_HUGEPAGE);
+#endif
+madvise(base,CACHE_SIZE,MADV_WILLNEED);
+MTAB = (Index *)((char *)base + CACHE_HEADER);
+printf("Mapped multiplication table from %s\n\n",path);
+return true;
+}
+
+//	All the output files are written via a temporary file, which is renamed over the file once
+//	it is complete, so that readers and concurrent runs never see a partly written file.
+//	openTemp opens the temporary file for path, leaving its name in tmp; commitTemp closes it,
+//	and renames it if ok and nothing failed, or removes it otherwise.
+
+#define TEMP_NAME_LEN 1024
+
+FILE *openTemp(const char *path, const char *mode, char *tmp)
+{
+snprintf(tmp,TEMP_NAME_LEN,"%s.%d.tmp",path,(int)getpid());
+return fopen(tmp,mode);
+}
+
+bool commitTemp(FILE *fp, const char *tmp, const char *path, bool ok = true)
+{
+ok = !ferror(fp) && ok;
+ok = (fclose(fp)==0) && ok;
+ok = ok && rename(tmp,path)==0;
+if (!ok) remove(tmp);
+return ok;
+}
+
+//	Write MTAB to the cache file
+
+void saveMultTable(const char *path)
+{
+char tmp[TEMP_NAME_LEN];
+FILE *fp = openTemp(path,"wb",tmp);
+if (fp==NULL)
+	{
+	printf("Error opening table cache %s to write\n\n",tmp);
+	return;
+	};
+
+char header[CACHE_HEADER];
+memset(header,0,sizeof(header));
+cacheHeader *h = (cacheHeader *)header;
+memcpy(h->magic,CACHE_MAGIC,8);
+h->version = CACHE_VERSION;
+h->nmono = nmono;
+h->nindex = nindex;
+h->key = tableKey();
+
+bool ok = fwrite(header,1,CACHE_HEADER,fp)==CACHE_HEADER
+	&& fwrite(MTAB,sizeof(Index)*nindex,nindex,fp)==(size_t)nindex;
+if (commitTemp(fp,tmp,path,ok)) printf("Saved multiplication table to %s\n\n",path);
+else printf("Error writing table cache %s\n\n",path);
+}
+
+//	Fill one row of MTAB with bit-sliced products, 64 at a time, or if right is true column
+//	x1, with the products y*x1
+
+void multRowSliced(Index x1, Index *row, bool right)
+{
+if (nindex<64)
+	{
+	for (int x2=0;x2<nindex;x2++) row[x2] = right ? multIndices(x2,x1) : multIndices(x1,x2);
+	return;
+	};
+Slice s1, s2, p;
+sliceBroadcast(s1,x1);
+for (int base=0;base<nindex;base+=64)
+	{
+	sliceRange(s2,base);
+	if (right) sliceMult(s2,s1,p);
+	else sliceMult(s1,s2,p);
+	sliceStore(p,row+base);
+	};
+}
+
+//	Fill one row of MTAB for other coefficient rules, summing the scaled monomial actions
+//	for the coefficients of x1, or if right is true column x1 from the right actions
+
+void multRowActions(Index x1, Index *row, bool right)
+{
+if (!scaledActions)
+	{
+	for (int x2=0;x2<nindex;x2++) row[x2] = right ? multIndices(x2,x1) : multIndices(x1,x2);
+	return;
+	};
+Index **acts = right ? MACTR : MACT;
+const Index *act[MAXMONO];
+for (int k=0;k<nmono;k++,x1/=nvalue) act[k] = acts[k] + (size_t)(x1%nvalue)*nindex;
+for (int x2=0;x2<nindex;x2++)
+	{
+	Index r = act[0][x2];
+	for (int k=1;k<nmono;k++) r = addIndicesSplit(r,act[k][x2]);
+	row[x2] = r;
+	};
+}
+
+//	Fill row x1 of the multiplication table, the products x1*y for every y, or if right is true
+//	column x1, the products y*x1, with the fastest kernel available
+
+void multRowAny(Index x1, Index *row, bool right)
+{
+if (kernels!=NULL)
+	{
+	kernels->multRow(x1,row,right);
+	return;
+	};
+#ifdef HAVE_AVX2_KERNEL
+if (avx2Rows)
+	{
+	multRowAVX2(x1,row,right ? MACTR : MACT);
+	return;
+	};
+#endif
+if (!twoBitCoeffs) multRowActions(x1,row,right);
+else multRowSliced(x1,row,right);
+}
+
+//	Build MTAB, with blocks of rows shared out among the threads
+
+void buildMultTable()
+{
+printf("Creating multiplication table with %d thread%s%s ...\n",numThreads,numThreads==1 ? "" : "s",kernels!=NULL ? " (compiled)" : avx2Rows ? " (AVX2)" : twoBitCoeffs ? " (bit-sliced)" : " (monomial actions)");
+double t0 = wallSeconds();
+MTAB = new Index[(size_t)nindex*nindex];
+parallelBlocks(nindex,64,[](int start, int end)
+	{
+	for (int x1=start;x1<end;x1++) multRowAny(x1,mtabRow(x1),false);
+	});
+printf("Done in %.3f s\n\n",wallSeconds()-t0);
+}
+
+//	A partition of the formal elements into equivalence classes, stored contiguously.  The
+//	classes are numbered 0 .. count-1 in order of their minimum elements, eqc[x] is the class
+//	of x, and the members of class c, in increasing order, are members[offset[c]] up to
+//	members[offset[c+1]-1].
+
+struct Partition
+{
+int count;
+Index *eqc;
+int *offset;
+Index *members;
+
+Partition() : count(0), eqc(NULL), offset(NULL), members(NULL) {}
+~Partition() { delete [] eqc; delete [] offset; delete [] members; }
+void allocate();
+void setFromLabels(const Index *label);
+void merge(int c1, int c2);
+bool validate() const;
+
+int size(int c) const { return offset[c+1]-offset[c]; }
+const Index *classMembers(int c) const { return members+offset[c]; }
+};
+
+//	Allocate the arrays for nindex elements, once nindex is known
+
+void Partition::allocate()
+{
+if (eqc!=NULL) return;
+eqc = new Index[nindex];
+offset = new int[nindex+1];
+members = new Index[nindex];
+}
+
+//	Set the partition in which x belongs to the class labelled label[x], for any labels from 0
+//	to nindex-1.  label may be eqc itself, so this also compacts the partition after merges.
+
+void Partition::setFromLabels(const Index *label)
+{
+int *cnum = new int[nindex];
+for (int k=0;k<nindex;k++) cnum[k] = -1;
+count = 0;
+for (int x=0;x<nindex;x++)
+	if (cnum[label[x]]<0) cnum[label[x]] = count++;
+for (int c=0;c<=count;c++) offset[c] = 0;
+for (int x=0;x<nindex;x++)
+	{
+	eqc[x] = cnum[label[x]];
+	offset[eqc[x]+1]++;
+	};
+for (int c=0;c<count;c++) offset[c+1] += offset[c];
+for (int x=0;x<nindex;x++) members[offset[eqc[x]]++] = x;
+for (int c=count;c>0;c--) offset[c] = offset[c-1];
+offset[0] = 0;
+delete [] cnum;
+}
+
+//	Merge class c2 into class c1, and compact the partition
+
+void Partition::merge(int c1, int c2)
+{
+for (int k=offset[c2];k<offset[c2+1];k++) eqc[members[k]] = c1;
+setFromLabels(eqc);
+}
+
+//	Check that the class lists and eqc agree, and that every element appears exactly once
+
+bool Partition::validate() const
+{
+if (count<1 || count>nindex || offset[0]!=0 || offset[count]!=nindex) return false;
+bool *seen = new bool[nindex];
+for (int x=0;x<nindex;x++) seen[x] = false;
+bool ok = true;
+for (int c=0;ok && c<count;c++)
+	{
+	if (offset[c+1]<=offset[c]) ok = false;
+	for (int k=offset[c];ok && k<offset[c+1];k++)
+		{
+		Index x = members[k];
+		if (x>=nindex || seen[x] || eqc[x]!=c || (k>offset[c] && x<=members[k-1])) ok = false;
+		else seen[x] = true;
+		};
+	};
+delete [] seen;
+return ok;
+}
+
+//	The equivalence classes of elements
+
+Partition classes;
+
+//	Sort equivalence classes by size
+
+int ecmp(const void *a, const void *b)
+{
+int e1 = *((int *)(a));
+int e2 = *((int *)(b));
+int s1 = classes.size(e1);
+int s2 = classes.size(e2);
+return s1-s2;
+}
+
+//	Output both the minimum element of each class, and all the classes
+
+void outputEC(FILE *fp, const Partition &P)
+{
+//	Output minimum element of each class
+
+fprintf(fp,"{");
+for (int c=0;c<P.count;c++)
+	{
+	if (c!=0) fprintf(fp,",\n");
+	printIndex(fp,P.classMembers(c)[0],false);
+	};
+fprintf(fp,"}\n\n");
+
+//	Output all elements of each class
+
+fprintf(fp,"{");
+for (int c=0;c<P.count;c++)
+	{
+	if (c!=0) fprintf(fp,",\n");
+	fprintf(fp,"{");
+	for (int j=0;j<P.size(c);j++)
+		{
+		if (j!=0) fprintf(fp,", ");
+		printIndex(fp,P.classMembers(c)[j],false);
+		};
+	fprintf(fp,"}");
+	};
+fprintf(fp,"}\n");
+}
+
+//	Write a partition to the output file, or to the console if the file can't be opened
+
+void writeOutput(const Partition &P)
+{
+char tmp[TEMP_NAME_LEN];
+FILE *fp = openTemp(OUTPUT_FILE,"wt",tmp);
+if (fp==NULL)
+	{
+	printf("Error opening output file %s to write\n",tmp);
+	printf("Sending output to console:\n");
+	outputEC(stdout,P);
+	}
+else
+	{
+	outputEC(fp,P);
+	if (!commitTemp(fp,tmp,OUTPUT_FILE)) printf("Error writing output file %s\n",OUTPUT_FILE);
+	};
+}
+
+//	Background writer for snapshots of the classes while the closure is running.  The closure
+//	only hands over a copy of the class labels; the writer thread writes the latest copy at
+//	most once every snapshotInterval seconds, so the closure never waits for file I/O.
+
+double snapshotInterval = 10;
+
+std::thread snapshotThread;
+std::mutex snapshotLock;
+std::condition_variable snapshotWake;
+Index *snapshotLabels = NULL;
+bool snapshotPending = false, snapshotStop = false;
+
+void snapshotWriter()
+{
+Index *label = new Index[nindex];
+Partition *P = new Partition;
+P->allocate();
+double lastWrite = -1e30;
+std::unique_lock<std::mutex> guard(snapshotLock);
+while (true)
+	{
+	snapshotWake.wait(guard,[]{return snapshotPending || snapshotStop;});
+	
+	//	Throttle, but stop waiting if we are told to stop
+	
+	double wait = lastWrite + snapshotInterval - wallSeconds();
+	if (wait > 0) snapshotWake.wait_for(guard,std::chrono::duration<double>(wait),[]{return snapshotStop;});
+	if (snapshotStop) break;
+	
+	memcpy(label,snapshotLabels,nindex*sizeof(Index));
+	snapshotPending = false;
+	guard.unlock();
+	P->setFromLabels(label);
+	writeOutput(*P);
+	lastWrite = wallSeconds();
+	guard.lock();
+	};
+delete P;
+delete [] label;
+}
+
+void startSnapshots()
+{
+if (snapshotInterval <= 0) return;
+if (snapshotLabels==NULL) snapshotLabels = new Index[nindex];
+snapshotPending = snapshotStop = false;
+snapshotThread = std::thread(snapshotWriter);
+}
+
+void submitSnapshot(const Index *label)
+{
+if (snapshotInterval <= 0) return;
+std::lock_guard<std::mutex> guard(snapshotLock);
+memcpy(snapshotLabels,label,nindex*sizeof(Index));
+snapshotPending = true;
+snapshotWake.notify_one();
+}
+
+//	Stop the writer, discarding any snapshot it has not yet written, since the final result
+//	supersedes it
+
+void stopSnapshots()
+{
+if (!snapshotThread.joinable()) return;
+snapshotLock.lock();
+snapshotStop = true;
+snapshotWake.notify_one();
+snapshotLock.unlock();
+snapshotThread.join();
+}
+
+//	The quotient rig: the classes of a congruence, numbered as in the partition (in order of
+//	their representatives, the smallest elements), with their addition and multiplication
+//	tables.  At 284x284 for two generators, both tables fit in cache.
+
+struct Quotient
+{
+int n;
+Index *rep;
+Index *add;
+Index *mul;
+
+Index sum(int c1, int c2) const { return add[c1*n+c2]; }
+Index product(int c1, int c2) const { return mul[c1*n+c2]; }
+};
+
+//	Build the tables from the representatives, a row per task on the worker threads; for a
+//	congruence the result doesn't depend on the choice of representatives
+
+void buildQuotient(const Partition &P, Quotient &Q)
+{
+Q.n = P.count;
+Q.rep = new Index[Q.n];
+Q.add = new Index[Q.n*Q.n];
+Q.mul = new Index[Q.n*Q.n];
+for (int c=0;c<Q.n;c++) Q.rep[c] = P.classMembers(c)[0];
+parallelBlocks(Q.n,1,[&](int c1, int)
+	{
+	for (int c2=0;c2<Q.n;c2++)
+		{
+		Q.add[c1*Q.n+c2] = P.eqc[addIndices(Q.rep[c1],Q.rep[c2])];
+		Q.mul[c1*Q.n+c2] = P.eqc[multiply(Q.rep[c1],Q.rep[c2])];
+		};
+	});
+}
+
+void freeQuotient(Quotient &Q)
+{
+delete [] Q.mul;
+delete [] Q.add;
+delete [] Q.rep;
+}
+
+//	Check the rig axioms on the tables: + associative, commutative, with identity the class of 0;
+//	* associative, with identity the class of 1 and the class of 0 absorbing; both distributive
+//	laws; and x*x = x.  The triple loops are shared between the worker threads a block of x at a
+//	time, with the y and z rows of both tables staying in cache.
+//
+//	Checking every triple is O(n^3), so above VALIDATE_ALL_CLASSES classes, unless fullValidation
+//	is set, the laws on triples are only checked for VALIDATE_SAMPLES pseudo-random triples.
+
+#define VALIDATE_ALL_CLASSES 512
+#define VALIDATE_SAMPLES (1 << 24)
+
+bool fullValidation = false;
+
+bool validateQuotient(const Quotient &Q, const Index *eqc)
+{
+int n = Q.n;
+int zero = eqc[0], one = eqc[1];
+std::atomic<int> failures(0);
+std::mutex reportLock;
+auto fail = [&](const char *law, int x, int y, int z)
+	{
+	std::lock_guard<std::mutex> guard(reportLock);
+	if (failures++ < 10) printf("Quotient fails %s for classes %d, %d, %d\n",law,x,y,z);
+	};
+
+for (int x=0;x<n;x++)
+	{
+	if (Q.product(x,x)!=x) fail("idempotence",x,x,x);
+	if (Q.sum(x,zero)!=x || Q.sum(zero,x)!=x) fail("additive identity",x,zero,x);
+	if (Q.product(x,one)!=x || Q.product(one,x)!=x) fail("multiplicative identity",x,one,x);
+	if (Q.product(x,zero)!=zero || Q.product(zero,x)!=zero) fail("absorbing zero",x,zero,zero);
+	for (int y=0;y<n;y++) if (Q.sum(x,y)!=Q.sum(y,x)) fail("commutativity of +",x,y,y);
+	};
+
+if (!fullValidation && n>VALIDATE_ALL_CLASSES)
+	{
+	printf("Checking the laws on %d random triples of classes; use --validate to check them all\n",VALIDATE_SAMPLES);
+	parallelBlocks(VALIDATE_SAMPLES,1<<16,[&](int start, int end)
+		{
+		for (int k=start;k<end;k++)
+			{
+			uint64_t h = (uint64_t)k * 0x9E3779B97F4A7C15ULL;
+			h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ULL;
+			h ^= h >> 29;
+			int x = (int)(h%n), y = (int)((h>>21)%n), z = (int)((h>>42)%n);
+			int xy = Q.product(x,y), xpy = Q.sum(x,y);
+			if (Q.product(xy,z)!=Q.product(x,Q.product(y,z))) fail("associativity of *",x,y,z);
+			if (Q.sum(xpy,z)!=Q.sum(x,Q.sum(y,z))) fail("associativity of +",x,y,z);
+			if (Q.product(x,Q.sum(y,z))!=Q.sum(xy,Q.product(x,z))) fail("left distributivity",x,y,z);
+			if (Q.product(xpy,z)!=Q.sum(Q.product(x,z),Q.product(y,z))) fail("right distributivity",x,y,z);
+			};
+		});
+	return failures==0;
+	};
+
+parallelBlocks(n,4,[&](int start, int end)
+	{
+	for (int x=start;x<end;x++)
+	for (int y=0;y<n;y++)
+		{
+		int xy = Q.product(x,y), xpy = Q.sum(x,y);
+		const Index *addY = Q.add+y*n, *mulY = Q.mul+y*n;
+		const Index *addXY = Q.add+xpy*n, *mulXY = Q.mul+xy*n;
+		const Index *addX = Q.add+x*n, *mulX = Q.mul+x*n;
+		for (int z=0;z<n;z++)
+			{
+			if (mulXY[z]!=mulX[mulY[z]]) fail("associativity of *",x,y,z);
+			if (addXY[z]!=addX[addY[z]]) fail("associativity of +",x,y,z);
+			if (mulX[addY[z]]!=Q.sum(xy,mulX[z])) fail("left distributivity",x,y,z);
+			if (Q.product(xpy,z)!=Q.sum(Q.product(x,z),Q.product(y,z))) fail("right distributivity",x,y,z);
+			};
+		};
+	});
+	
+return failures==0;
+}
+
+//	Write the quotient to a file in the same style as the output file: a list of the
+//	representatives, then the addition and multiplication tables as lists of rows of class
+//	numbers, counting from 0 in the order of that list
+
+void writeQuotient(const Quotient &Q)
+{
+char tmp[TEMP_NAME_LEN];
+FILE *fp = openTemp(TABLES_FILE,"wt",tmp);
+if (fp==NULL)
+	{
+	printf("Error opening tables file %s to write\n",tmp);
+	return;
+	};
+	
+fprintf(fp,"{");
+for (int c=0;c<Q.n;c++)
+	{
+	if (c!=0) fprintf(fp,",\n");
+	printIndex(fp,Q.rep[c],false);
+	};
+fprintf(fp,"}\n");
+for (int t=0;t<2;t++)
+	{
+	const Index *table = (t==0) ? Q.add : Q.mul;
+	fprintf(fp,"\n{");
+	for (int c1=0;c1<Q.n;c1++)
+		{
+		if (c1!=0) fprintf(fp,",\n");
+		fprintf(fp,"{");
+		for (int c2=0;c2<Q.n;c2++) fprintf(fp,c2==0 ? "%d" : ",%d",table[c1*Q.n+c2]);
+		fprintf(fp,"}");
+		};
+	fprintf(fp,"}\n");
+	};
+	
+if (!commitTemp(fp,tmp,TABLES_FILE)) printf("Error writing tables file %s\n",TABLES_FILE);
+}
+
+//	Write the quotient to the binary rig file described in RigFile.h, then map it with the
+//	loader and check that it gives back the same tables
+
+bool writeRigFile(const Quotient &Q, const Index *eqc)
+{
+RigFileHeader h;
+memset(&h,0,sizeof(h));
+memcpy(h.magic,RIG_FILE_MAGIC,8);
+h.version = RIG_FILE_VERSION;
+rigFileLayout(h,nmono,coeffK,coeffP,Q.n);
+
+char *buf = new char[h.size];
+memset(buf,0,h.size);
+memcpy(buf,&h,sizeof(h));
+uint16_t *mt = (uint16_t *)(buf+h.mtabOffset);
+for (int i=0;i<nmono;i++)
+for (int j=0;j<nmono;j++)
+	mt[i*nmono+j] = (uint16_t)mtab[i][j];
+for (int i=0;i<nmono;i++) memcpy(buf+h.nameOffset+i*RIG_NAME_LEN,mtext[i],RIG_NAME_LEN);
+memcpy(buf+h.eqcOffset,eqc,nindex*sizeof(Index));
+memcpy(buf+h.repOffset,Q.rep,Q.n*sizeof(Index));
+memcpy(buf+h.addOffset,Q.add,Q.n*Q.n*sizeof(Index));
+memcpy(buf+h.mulOffset,Q.mul,Q.n*Q.n*sizeof(Index));
+
+char tmp[TEMP_NAME_LEN];
+FILE *fp = openTemp(RIG_FILE,"wb",tmp);
+bool ok = fp!=NULL && commitTemp(fp,tmp,RIG_FILE,fwrite(buf,1,h.size,fp)==h.size);
+delete [] buf;
+if (!ok)
+	{
+	printf("Error writing rig file %s\n",RIG_FILE);
+	return false;
+	};
+
+RigFile rf;
+if (!rigFileOpen(rf,RIG_FILE))
+	{
+	printf("Rig file %s could not be loaded back\n",RIG_FILE);
+	return false;
+	};
+ok = rf.nclasses==(uint32_t)Q.n && rigInteger(rf,1)==eqc[1]
+	&& (nmono<2 || rigMonomial(rf,1)==eqc[monoIndex[1]]);
+for (int x=0;ok && x<nindex;x++) ok = rigNormalize(rf,x)==eqc[x];
+for (int c1=0;ok && c1<Q.n;c1++)
+	{
+	ok = rigRepresentative(rf,c1)==Q.rep[c1];
+	for (int c2=0;ok && c2<Q.n;c2++)
+		ok = rigAdd(rf,c1,c2)==Q.sum(c1,c2) && rigMul(rf,c1,c2)==Q.product(c1,c2);
+	};
+rigFileClose(rf);
+if (!ok) printf("Rig file %s does not match the tables\n",RIG_FILE);
+return ok;
+}
+
+//	Checkpoints of the equivalence classes.
+//
+//	The file holds a header, the class label of every element, then the classes themselves as
+//	offsets into a single list of members, sorted by label.  The union-find closure also saves
+//	its worklist of linked pairs whose consequences have not yet been examined; every other link
+//	has been fully examined, so the closure can carry on from exactly where it was.
+
+#define CHECKPOINT_MAGIC "IRigCKPT"
+#define CHECKPOINT_VERSION 1
+
+struct checkpointHeader
+{
+char magic[8];
+uint32_t version, nmono;
+uint64_t nindex, key;
+uint32_t nclasses, npending;
+uint32_t worklist;			//	1 if the pending pairs are the only unexamined links
+uint32_t reserved;
+};
+
+const char *checkpointPath = CHECKPOINT_FILE;
+double checkpointInterval = 60;
+double lastCheckpoint;
+
+bool checkpointDue()
+{
+return checkpointInterval > 0 && wallSeconds()-lastCheckpoint >= checkpointInterval;
+}
+
+//	Save a partition and the pending pairs, via a temporary file so that an interrupted write
+//	never replaces the previous checkpoint
+
+void saveCheckpoint(const Partition &P, const Index *pendA, const Index *pendB, int npending, bool worklist)
+{
+checkpointHeader h;
+memset(&h,0,sizeof(h));
+memcpy(h.magic,CHECKPOINT_MAGIC,8);
+h.version = CHECKPOINT_VERSION;
+h.nmono = nmono;
+h.nindex = nindex;
+h.key = tableKey();
+h.nclasses = P.count;
+h.npending = npending;
+h.worklist = worklist ? 1 : 0;
+
+char tmp[TEMP_NAME_LEN];
+FILE *fp = openTemp(checkpointPath,"wb",tmp);
+bool ok = fp!=NULL;
+if (ok)
+	{
+	ok = fwrite(&h,sizeof(h),1,fp)==1
+		&& fwrite(P.eqc,sizeof(Index),nindex,fp)==(size_t)nindex
+		&& fwrite(P.offset,sizeof(P.offset[0]),P.count+1,fp)==(size_t)(P.count+1)
+		&& fwrite(P.members,sizeof(Index),nindex,fp)==(size_t)nindex
+		&& fwrite(pendA,sizeof(Index),npending,fp)==(size_t)npending
+		&& fwrite(pendB,sizeof(Index),npending,fp)==(size_t)npending;
+	ok = commitTemp(fp,tmp,checkpointPath,ok);
+	};
+if (ok) printf("Saved checkpoint with %d equivalence classes to %s\n",P.count,checkpointPath);
+else printf("Error writing checkpoint %s\n",checkpointPath);
+lastCheckpoint = wallSeconds();
+}
+
+//	Load the equivalence classes from the checkpoint, and the pending pairs into pendA, pendB
+
+bool loadCheckpoint(Index *pendA, Index *pendB, int &npending, bool &worklist)
+{
+FILE *fp = fopen(checkpointPath,"rb");
+if (fp==NULL)
+	{
+	printf("No checkpoint %s to resume from\n",checkpointPath);
+	return false;
+	};
+
+checkpointHeader h;
+Partition *P = new Partition;
+P->allocate();
+bool ok = fread(&h,sizeof(h),1,fp)==1
+	&& memcmp(h.magic,CHECKPOINT_MAGIC,8)==0 && h.version==CHECKPOINT_VERSION
+	&& h.nmono==(uint32_t)nmono && h.nindex==(uint64_t)nindex && h.key==tableKey()
+	&& h.nclasses>=1 && h.nclasses<=(uint32_t)nindex && h.npending<=(uint32_t)nindex
+	&& fread(P->eqc,sizeof(Index),nindex,fp)==(size_t)nindex
+	&& fread(P->offset,sizeof(P->offset[0]),h.nclasses+1,fp)==h.nclasses+1
+	&& fread(P->members,sizeof(Index),nindex,fp)==(size_t)nindex
+	&& fread(pendA,sizeof(Index),h.npending,fp)==h.npending
+	&& fread(pendB,sizeof(Index),h.npending,fp)==h.npending;
+fclose(fp);
+
+P->count = h.nclasses;
+if (ok && P->validate())
+	{
+	classes.setFromLabels(P->eqc);
+	npending = h.npending;
+	worklist = h.worklist!=0;
+	printf("Resumed from checkpoint %s with %d equivalence classes\n\n",checkpointPath,classes.count);
+	}
+else
+	{
+	ok = false;
+	printf("Checkpoint %s is invalid or for different tables\n",checkpointPath);
+	};
+
+delete P;
+return ok;
+}
+
+//	Number of multiplications and additions made by the closure engines
+
+uint64_t tableLookups = 0;
+
+//	Whether the checks report progress for each class, and a limit on the table lookups the
+//	full check may make before it gives up without a verdict
+
+bool checkVerbose = true;
+uint64_t fullCheckLimit = UINT64_MAX;
+bool fullCheckAborted = false;
+
+//	Ways of checking whether the current equivalence classes form a congruence
+
+enum CheckMode
+{
+CHECK_FULL,		//	every x1~x2 against every y1~y2
+CHECK_REP,		//	every x against the representative of its class, for every y
+CHECK_GEN		//	every x against the representative of its class, for the generating unary maps
+};
+
+const char *checkModeName[] = {"full", "rep", "gen"};
+
+//	Full check: we check pairs of elements that are in the same equivalence class,
+//	x1==x2, y1==y2, and if:
+//
+//	x1*y1 and x2*y2 are not in the same class
+//	x1+y1 and x2+y2 are not in the same class
+//
+//	we return the two classes that must be merged.
+//
+//	The checks are made one class x at a time, by worker threads that each take the next
+//	class in the order given by cnum.  A worker stops as soon as a class earlier in that order
+//	is known to have a mismatch, and the witness from the earliest such class is the one
+//	returned, so the merges made don't depend on the number of threads.
+
+struct CheckState
+{
+std::atomic<int> first;			//	position in cnum of the earliest class with a mismatch
+std::atomic<uint64_t> lookups;	//	table lookups made by the workers so far
+std::atomic<bool> aborted;		//	the full check gave up at fullCheckLimit
+};
+
+inline bool cancelled(const CheckState &state, int position)
+{
+return state.first.load(std::memory_order_relaxed) < position || state.aborted.load(std::memory_order_relaxed);
+}
+
+bool classMismatchFull(int cx, int position, int passCount, CheckState &state, uint64_t &lookups, int &c1, int &c2)
+{
+const Index *eqc = classes.eqc;
+const Index *X = classes.classMembers(cx);
+int nx = classes.size(cx);
+
+if (checkVerbose) printf("passCount = %d, outerCount = %d / %d, elements = %d\n",passCount, position+1,classes.count,nx);
+
+for (int k1=0;k1<nx;k1++)
+	{
+	Index x1 = X[k1];
+	for (int k2=0;k2<nx;k2++)
+		{
+		Index x2 = X[k2];
+		
+		state.lookups += lookups;
+		lookups = 0;
+		if (tableLookups + state.lookups > fullCheckLimit) state.aborted = true;
+		if (cancelled(state,position)) return false;
+		
+		for (int cy=0;cy<classes.count;cy++)
+			{
+			const Index *Y = classes.classMembers(cy);
+			int ny = classes.size(cy);
+			for (int q1=0;q1<ny;q1++)
+				{
+				Index y1 = Y[q1];
+				for (int q2=0;q2<ny;q2++)
+					{
+					Index y2 = Y[q2];
+					
+					c1 = eqc[multiply(x1,y1)];
+					c2 = eqc[multiply(x2,y2)];
+					if (c1!=c2)
+						{
+						lookups += 2;
+						return true;
+						};
+
+					c1 = eqc[addIndices(x1,y1)];
+					c2 = eqc[addIndices(x2,y2)];
+					lookups += 4;
+					if (c1!=c2) return true;
+					};
+				};
+			};
+		};
+	};
+return false;
+}
+
+//	Representative check: if r is the smallest element of its class, then x1~x2 and y1~y2 imply
+//	x1*y1 ~ x2*y2 and x1+y1 ~ x2+y2 for all such quadruples if and only if, for every x~r and
+//	every y:
+//
+//	x*y ~ r*y,  y*x ~ y*r,  x+y ~ r+y
+//
+//	since x1*y1 ~ r*y1 ~ r*y2 ~ x2*y2, and similarly for +.  This is quadratic rather than
+//	quartic in the class sizes.
+
+bool classMismatchRep(int cx, int position, int passCount, CheckState &state, uint64_t &lookups, int &c1, int &c2)
+{
+const Index *eqc = classes.eqc;
+const Index *X = classes.classMembers(cx);
+int nx = classes.size(cx);
+
+if (checkVerbose) printf("passCount = %d, outerCount = %d / %d, elements = %d\n",passCount, position+1,classes.count,nx);
+
+Index r = X[0];
+for (int k=1;k<nx;k++)
+	{
+	Index x = X[k];
+	if (cancelled(state,position)) return false;
+	for (int y=0;y<nindex;y++)
+		{
+		c1 = eqc[multiply(r,y)];
+		c2 = eqc[multiply(x,y)];
+		if (c1!=c2)
+			{
+			lookups += 2;
+			return true;
+			};
+		
+		c1 = eqc[addIndices(r,y)];
+		c2 = eqc[addIndices(x,y)];
+		lookups += 4;
+		if (c1!=c2) return true;
+		};
+	};
+
+//	Left multiplication is checked a row at a time, rather than down the columns of MTAB
+
+if (cancelled(state,position)) return false;
+for (int y=0;y<nindex;y++)
+	{
+	c1 = eqc[multiply(y,r)];
+	for (int k=1;k<nx;k++)
+		{
+		c2 = eqc[multiply(y,X[k])];
+		lookups++;
+		if (c1!=c2) return true;
+		};
+	lookups++;
+	};
+return false;
+}
+
+//	Generating unary maps.
+//
+//	Multiplication is generated by left and right multiplication by the generators of the
+//	monoid, and addition by adding single monomials.  If x~x' implies f(x)~f(x') for each of
+//	these maps f, then x*w ~ x'*w and w*x ~ w*x' for every monomial w, x+y ~ x'+y for every
+//	y (adding y's monomials one at a time), and so by distributivity x*y ~ x'*y and
+//	y*x ~ y*x' for every y.  Closure under these maps is therefore enough for a congruence.
+
+#define MAXUMAP (3*MAXMONO)
+
+int ngens;
+int gens[MAXSPARSEMONO];
+
+Index *UMAP[MAXUMAP];
+char umapText[MAXUMAP][RIG_NAME_LEN+4];
+int numUMaps;
+
+//	Find generators for the monoid: take each monomial in turn, unless it is already a product
+//	of those found so far
+
+void findGenerators()
+{
+bool reached[MAXSPARSEMONO];
+for (int i=0;i<nmono;i++) reached[i] = (i==0);
+ngens = 0;
+for (int m=1;m<nmono;m++)
+if (!reached[m])
+	{
+	gens[ngens++] = m;
+	bool grew = true;
+	while (grew)
+		{
+		grew = false;
+		for (int i=0;i<nmono;i++)
+		if (reached[i])
+		for (int g=0;g<ngens;g++)
+		if (!reached[mtab[i][gens[g]]])
+			{
+			reached[mtab[i][gens[g]]] = true;
+			grew = true;
+			};
+		};
+	};
+}
+
+//	Tabulate the unary maps g*x, x*g for each generator g, and x+m for each monomial m,
+//	with multiply and addIndices
+
+void setupUnaryMaps()
+{
+findGenerators();
+for (int u=0;u<2*ngens+nmono;u++) UMAP[u] = new Index[nindex];
+numUMaps = 0;
+for (int g=0;g<ngens;g++)
+	{
+	Index gi = monoIndex[gens[g]];
+	for (int x=0;x<nindex;x++) UMAP[numUMaps][x] = multiply(gi,x);
+	snprintf(umapText[numUMaps++],sizeof(umapText[0]),"%s*x",mtext[gens[g]]);
+	for (int x=0;x<nindex;x++) UMAP[numUMaps][x] = multiply(x,gi);
+	snprintf(umapText[numUMaps++],sizeof(umapText[0]),"x*%s",mtext[gens[g]]);
+	};
+for (int m=0;m<nmono;m++)
+	{
+	Index mi = monoIndex[m];
+	for (int x=0;x<nindex;x++) UMAP[numUMaps][x] = addIndices(x,mi);
+	snprintf(umapText[numUMaps++],sizeof(umapText[0]),"x+%.*s",RIG_NAME_LEN,mtext[m]);
+	};
+	
+printf("Generating unary maps:");
+for (int u=0;u<numUMaps;u++) printf(" %s",umapText[u]);
+printf("\n\n");
+}
+
+//	Union-find that several threads can update at once without a lock.  Links are made with a
+//	compare-and-swap, always from the larger root to the smaller one, so each root is the
+//	smallest element of its set whatever order the links are made in.  find() halves the path
+//	as it goes, pointing every other node at its grandparent; that only ever moves a parent to
+//	a smaller ancestor, so it needs no lock either.
+
+struct ConcurrentUF
+{
+std::atomic<Index> *parent;
+
+ConcurrentUF() : parent(new std::atomic<Index>[nindex]) {}
+~ConcurrentUF() { delete [] parent; }
+
+void reset(int n)
+	{
+	for (int x=0;x<n;x++) parent[x].store((Index)x,std::memory_order_relaxed);
+	};
+
+Index find(Index x)
+	{
+	Index p = parent[x].load(std::memory_order_relaxed);
+	while (p != x)
+		{
+		Index gp = parent[p].load(std::memory_order_relaxed);
+		if (gp==p) return p;
+		parent[x].compare_exchange_weak(p,gp,std::memory_order_relaxed);
+		x = gp;
+		p = parent[x].load(std::memory_order_relaxed);
+		};
+	return x;
+	};
+
+//	Join the sets containing x and y, returning true if they were different
+	
+bool unite(Index x, Index y)
+	{
+	while (true)
+		{
+		x = find(x);
+		y = find(y);
+		if (x==y) return false;
+		if (x>y) std::swap(x,y);
+		Index expected = y;
+		if (parent[y].compare_exchange_strong(expected,x,std::memory_order_acq_rel)) return true;
+		};
+	};
+};
+
+//	Symmetries.
+//
+//	A permutation p of the monomials with p(m1*m2) = p(m1)*p(m2) (an automorphism), or with
+//	p(m1*m2) = p(m2)*p(m1) (an anti-automorphism), extends to the formal elements by permuting
+//	their coefficients.  It then preserves addition, and preserves or reverses multiplication,
+//	so it maps x ~ x^2 to p(x) ~ p(x)^2, and the congruence those relations generate is
+//	invariant under it.  For mtab these are the a<->b swap and word reversal.
+
+int nsym;
+int symMono[2*5040][MAXMONO];
+bool symAnti[2*5040];
+Index **SYM;
+bool symGensInvariant;
+
+//	Find all the symmetries of mtab, by trying every permutation of the monomials, and
+//	tabulate their action on the formal elements
+
+void setupSymmetries()
+{
+int p[MAXMONO];
+for (int i=0;i<nmono;i++) p[i] = i;
+nsym = 0;
+do
+	{
+	bool autom = true, anti = true;
+	for (int i=0;i<nmono;i++)
+	for (int j=0;j<nmono;j++)
+		{
+		if (p[mtab[i][j]]!=mtab[p[i]][p[j]]) autom = false;
+		if (p[mtab[i][j]]!=mtab[p[j]][p[i]]) anti = false;
+		};
+	for (int kind=0;kind<2;kind++)
+	if (kind==0 ? autom : anti)
+		{
+		for (int i=0;i<nmono;i++) symMono[nsym][i] = p[i];
+		symAnti[nsym++] = (kind==1);
+		};
+	} while (std::next_permutation(p,p+nmono));
+	
+SYM = new Index *[nsym];
+for (int s=0;s<nsym;s++) SYM[s] = new Index[nindex];
+for (int s=0;s<nsym;s++)
+for (int x=0;x<nindex;x++)
+	{
+	int t[MAXMONO], u[MAXMONO];
+	indexToTuple(x,t);
+	for (int i=0;i<nmono;i++) u[symMono[s][i]] = t[i];
+	SYM[s][x] = tupleToIndex(u);
+	};
+	
+//	The generator check only covers the images of a class if the generators are permuted
+//	among themselves
+
+symGensInvariant = true;
+for (int s=0;s<nsym;s++)
+for (int g=0;g<ngens;g++)
+	{
+	bool found = false;
+	for (int h=0;h<ngens;h++) if (symMono[s][gens[g]]==gens[h]) found = true;
+	if (!found) symGensInvariant = false;
+	};
+	
+printf("Symmetries of the monomial multiplication table:\n");
+for (int s=0;s<nsym;s++)
+	{
+	printf("  %s ",symAnti[s] ? "anti-automorphism" : "automorphism     ");
+	for (int i=0;i<nmono;i++) printf(" %s->%s",mtext[i],mtext[symMono[s][i]]);
+	printf("\n");
+	};
+printf("\n");
+}
+
+//	Check on random pairs that the symmetries act on the formal elements as they should
+
+bool testSymmetries()
+{
+srandom(1);
+for (int k=0;k<(1<<16);k++)
+	{
+	Index x = (Index)(random()%nindex), y = (Index)(random()%nindex);
+	for (int s=0;s<nsym;s++)
+		{
+		Index px = SYM[s][x], py = SYM[s][y];
+		if (SYM[s][addIndices(x,y)]!=addIndices(px,py)
+			|| SYM[s][multiply(x,y)]!=(symAnti[s] ? multiply(py,px) : multiply(px,py)))
+			{
+			printf("Symmetry %d fails for x=%d, y=%d\n",s,x,y);
+			return false;
+			};
+		};
+	};
+return true;
+}
+
+//	Merge classes so that the partition is invariant under the symmetries: the result is
+//	generated by p(x) ~ p(r) for each element x with representative r, and each symmetry p.
+//	Since the symmetries form a group, one round of merges is enough.
+
+void symmetrizeClasses()
+{
+ConcurrentUF *uf = new ConcurrentUF;
+uf->reset(nindex);
+for (int s=0;s<nsym;s++)
+for (int x=0;x<nindex;x++)
+	uf->unite(SYM[s][x],SYM[s][classes.classMembers(classes.eqc[x])[0]]);
+Index *label = new Index[nindex];
+for (int x=0;x<nindex;x++) label[x] = uf->find(x);
+classes.setFromLabels(label);
+delete [] label;
+delete uf;
+}
+
+//	List the classes that are the first of their orbits under the symmetries, smallest first.
+//	For a symmetric partition, the others have a mismatch exactly when their image does, as
+//	long as the check is itself symmetric: the rep and gen checks test both x*y and y*x, but
+//	the full check only tests x as the left factor, which an anti-automorphism turns into the
+//	right factor, so it can only use the orbits when there are no anti-automorphisms.
+
+int listOrbitClasses(int *cnum)
+{
+int nc = 0;
+for (int c=0;c<classes.count;c++)
+	{
+	Index r = classes.classMembers(c)[0];
+	bool first = true;
+	for (int s=0;s<nsym;s++) if (classes.eqc[SYM[s][r]] < c) first = false;
+	if (first) cnum[nc++] = c;
+	};
+qsort(cnum,nc,sizeof(cnum[0]),ecmp);
+return nc;
+}
+
+//	Generator check: every x against the representative r of its class, for each unary map
+
+bool classMismatchGen(int cx, uint64_t &lookups, int &c1, int &c2)
+{
+const Index *eqc = classes.eqc;
+const Index *X = classes.classMembers(cx);
+int nx = classes.size(cx);
+Index r = X[0];
+for (int u=0;u<numUMaps;u++)
+	{
+	c1 = eqc[UMAP[u][r]];
+	lookups++;
+	for (int k=1;k<nx;k++)
+		{
+		c2 = eqc[UMAP[u][X[k]]];
+		lookups++;
+		if (c1!=c2) return true;
+		};
+	};
+return false;
+}
+
+//	Check the classes listed in cnum in parallel, returning the mismatch from the earliest
+//	class that has one
+
+bool findMismatch(CheckMode mode, int *cnum, int nc, int passCount, int &c1, int &c2)
+{
+CheckState state;
+state.first = nc;
+state.lookups = 0;
+state.aborted = false;
+std::mutex witnessLock;
+
+parallelBlocks(nc,1,[&](int position, int)
+	{
+	if (cancelled(state,position)) return;
+	uint64_t lookups = 0;
+	int w1 = -1, w2 = -1;
+	bool found = false;
+	switch (mode)
+		{
+		case CHECK_FULL: found = classMismatchFull(cnum[position],position,passCount,state,lookups,w1,w2); break;
+		case CHECK_REP: found = classMismatchRep(cnum[position],position,passCount,state,lookups,w1,w2); break;
+		case CHECK_GEN: found = classMismatchGen(cnum[position],lookups,w1,w2); break;
+		};
+	state.lookups += lookups;
+	if (found)
+		{
+		std::lock_guard<std::mutex> guard(witnessLock);
+		if (position < state.first)
+			{
+			state.first = position;
+			c1 = w1;
+			c2 = w2;
+			};
+		};
+	});
+
+tableLookups += state.lookups;
+if (state.aborted)
+	{
+	fullCheckAborted = true;
+	return false;
+	};
+return state.first < nc;
+}
+
+//	Fingerprint check: give each class a random 64-bit weight, and each element x a fingerprint
+//	that sums the weights of the classes of x*y, y*x and x+y, with random multipliers, for a
+//	random sample of y.  If two elements of a class have different fingerprints, one of the
+//	sampled products or sums must differ, and we return the two classes involved.  A mismatch
+//	outside the sample can go unseen, so finding nothing proves nothing; a fresh sample is
+//	drawn for each call.
+
+int fingerprintSamples = 0;
+
+inline uint64_t random64()
+{
+return ((uint64_t)random() << 42) ^ ((uint64_t)random() << 21) ^ (uint64_t)random();
+}
+
+bool findMismatchFingerprint(int *cnum, int nc, int &c1, int &c2)
+{
+int ns = fingerprintSamples;
+Index *sample = new Index[ns];
+uint64_t *mult = new uint64_t[3*ns];
+uint64_t *weight = new uint64_t[classes.count];
+uint64_t *fp = new uint64_t[nindex];
+for (int j=0;j<ns;j++) sample[j] = (Index)(random()%nindex);
+for (int j=0;j<3*ns;j++) mult[j] = random64() | 1;
+for (int c=0;c<classes.count;c++) weight[c] = random64();
+
+//	Elements alone in their class can't show a mismatch
+
+int singletons = 0;
+for (int c=0;c<classes.count;c++) if (classes.size(c)==1) singletons++;
+
+const Index *eqc = classes.eqc;
+parallelBlocks(nindex,256,[&](int start, int end)
+	{
+	for (int x=start;x<end;x++)
+		{
+		if (classes.size(eqc[x])==1) continue;
+		uint64_t f = 0;
+		for (int j=0;j<ns;j++)
+			{
+			Index y = sample[j];
+			f += mult[3*j]*weight[eqc[multiply(x,y)]]
+				+ mult[3*j+1]*weight[eqc[multiply(y,x)]]
+				+ mult[3*j+2]*weight[eqc[addIndices(x,y)]];
+			};
+		fp[x] = f;
+		};
+	});
+tableLookups += (uint64_t)3*ns*(nindex-singletons);
+
+bool found = false;
+for (int outerCount=0;!found && outerCount<nc;outerCount++)
+	{
+	const Index *X = classes.classMembers(cnum[outerCount]);
+	Index r = X[0];
+	for (int k=1;!found && k<classes.size(cnum[outerCount]);k++)
+	if (fp[X[k]]!=fp[r])
+		{
+		Index x = X[k];
+		for (int j=0;!found && j<ns;j++)
+			{
+			Index y = sample[j];
+			c1 = eqc[multiply(r,y)];	c2 = eqc[multiply(x,y)];
+			if (c1!=c2) { found = true; break; };
+			c1 = eqc[multiply(y,r)];	c2 = eqc[multiply(y,x)];
+			if (c1!=c2) { found = true; break; };
+			c1 = eqc[addIndices(r,y)];	c2 = eqc[addIndices(x,y)];
+			if (c1!=c2) { found = true; break; };
+			};
+		};
+	};
+
+delete [] fp;
+delete [] weight;
+delete [] mult;
+delete [] sample;
+return found;
+}
+
+//	List the equivalence classes in cnum, smallest first, returning their number
+
+int listClasses(int *cnum)
+{
+for (int c=0;c<classes.count;c++) cnum[c] = c;
+qsort(cnum,classes.count,sizeof(cnum[0]),ecmp);
+return classes.count;
+}
+
+
+//	Restart closure: look for a mismatch with the chosen check, merge the associated classes
+//	and start again from scratch, until no mismatch is found or maxPasses merges have been made.
+//	With fingerprintSamples, the fingerprint check is tried first, and the chosen check is
+//	only made when that finds nothing.
+//
+//	With useSymmetry, the partition is kept invariant under the symmetries of mtab by merging
+//	the images of each merged pair too, and only one class from each orbit is checked.
+
+bool useSymmetry = false;
+
+void restartClosure(CheckMode mode, int maxPasses)
+{
+int *cnum = new int[classes.count];
+
+bool anti = false;
+for (int s=0;s<nsym;s++) anti = anti || symAnti[s];
+bool orbits = useSymmetry && (mode!=CHECK_GEN || symGensInvariant) && (mode!=CHECK_FULL || !anti);
+if (useSymmetry)
+	{
+	int before = classes.count;
+	symmetrizeClasses();
+	printf("Symmetrized the partition, %d classes became %d\n",before,classes.count);
+	if (!orbits && mode==CHECK_FULL) printf("The full check is not symmetric under anti-automorphisms, so all classes will be checked\n");
+	else if (!orbits) printf("The generators are not permuted by the symmetries, so all classes will be checked\n");
+	};
+
+int passCount = 0;
+while (passCount < maxPasses)
+	{
+	int c1 = -1, c2 =-1;
+	int nc = orbits ? listOrbitClasses(cnum) : listClasses(cnum);
+	
+	double t0 = wallSeconds();
+	const char *check = "fingerprint";
+	bool found = fingerprintSamples>0 && findMismatchFingerprint(cnum,nc,c1,c2);
+	if (!found)
+		{
+		check = checkModeName[mode];
+		found = findMismatch(mode,cnum,nc,passCount,c1,c2);
+		};
+	printf("Pass %d with %s check of %d classes took %.3f s\n",passCount,check,nc,wallSeconds()-t0);
+	
+	if (!found) break;
+	
+	printf("Merging classes ... (table lookups so far = %" PRIu64 ")\n",tableLookups);
+	classes.merge(c1,c2);
+	if (useSymmetry) symmetrizeClasses();
+	submitSnapshot(classes.eqc);
+	if (checkpointDue()) saveCheckpoint(classes,NULL,NULL,0,false);
+	
+	passCount++;
+	};
+
+if (passCount==maxPasses) printf("Stopped after %d passes\n",passCount);
+
+delete [] cnum;
+}
+
+//	Signature of x: a hash of the classes of u(x) for each of the generating unary maps.  The
+//	classes form a congruence when every element has the same signature as its representative.
+
+inline uint64_t signature(const Index *eqc, Index x)
+{
+uint64_t h = 14695981039346656037ULL;
+for (int u=0;u<numUMaps;u++)
+	{
+	h ^= eqc[UMAP[u][x]];
+	h *= 1099511628211ULL;
+	};
+return h;
+}
+
+//	Sweep closure: compute the signatures of all elements from one fixed set of classes, then
+//	for every element whose signature differs from its representative's, merge the classes of
+//	u(x) and u(r) for each unary map u.  All these merges are made together at the end of the
+//	sweep, and sweeps are repeated until one finds nothing to merge.  Since equal signatures
+//	could hide a hash collision, that last sweep is confirmed with the generator check.
+//
+//	The signatures and the classes are shared between the worker threads, which record the
+//	merges in a concurrent union-find over the class numbers.
+//
+//	With useSymmetry, the classes are symmetrized before the first sweep and after each one;
+//	the images of forced merges are forced too, so this only brings merges forward.
+
+void sweepClosure(int maxSweeps)
+{
+uint64_t *sig = new uint64_t[nindex];
+ConcurrentUF *uf = new ConcurrentUF;
+Index *label = new Index[nindex];
+int *cnum = new int[nindex];
+
+if (useSymmetry)
+	{
+	int before = classes.count;
+	symmetrizeClasses();
+	printf("Symmetrized the partition, %d classes became %d\n",before,classes.count);
+	};
+
+int sweep = 0;
+while (sweep < maxSweeps)
+	{
+	double t0 = wallSeconds();
+	const Index *eqc = classes.eqc;
+	parallelBlocks(nindex,256,[&](int start, int end)
+		{
+		for (int x=start;x<end;x++) sig[x] = signature(eqc,x);
+		});
+	tableLookups += (uint64_t)numUMaps*nindex;
+	
+	uf->reset(classes.count);
+	std::atomic<int> differing(0), merges(0);
+	std::atomic<uint64_t> lookups(0);
+	parallelBlocks(classes.count,16,[&](int start, int end)
+		{
+		int d = 0, m = 0;
+		uint64_t n = 0;
+		for (int c=start;c<end;c++)
+			{
+			const Index *X = classes.classMembers(c);
+			Index r = X[0];
+			for (int k=1;k<classes.size(c);k++)
+			if (sig[X[k]]!=sig[r])
+				{
+				d++;
+				for (int u=0;u<numUMaps;u++)
+					if (uf->unite(eqc[UMAP[u][r]],eqc[UMAP[u][X[k]]])) m++;
+				n += 2*numUMaps;
+				};
+			};
+		differing += d;
+		merges += m;
+		lookups += n;
+		});
+	tableLookups += lookups;
+		
+	//	Nothing to merge, unless two signatures collided
+	
+	if (merges==0)
+		{
+		int c1 = -1, c2 = -1;
+		int nc = listClasses(cnum);
+		if (findMismatch(CHECK_GEN,cnum,nc,sweep,c1,c2))
+			{
+			printf("Sweep %d: signature collision, merging the classes found by the gen check\n",sweep);
+			uf->unite(c1,c2);
+			merges++;
+			};
+		};
+		
+	for (int x=0;x<nindex;x++) label[x] = uf->find(eqc[x]);
+	classes.setFromLabels(label);
+	if (useSymmetry && merges>0) symmetrizeClasses();
+	printf("Sweep %d: %d elements differ from their representatives, %d merges, %d classes, took %.3f s\n",
+		sweep,differing.load(),merges.load(),classes.count,wallSeconds()-t0);
+	sweep++;
+	if (merges==0) break;
+	
+	submitSnapshot(classes.eqc);
+	if (checkpointDue()) saveCheckpoint(classes,NULL,NULL,0,false);
+	};
+
+if (sweep==maxSweeps) printf("Stopped after %d sweeps\n",sweep);
+
+delete [] cnum;
+delete [] label;
+delete uf;
+delete [] sig;
+}
+
+//	Run the three checks on the current classes and make sure they agree about whether there is
+//	a mismatch.  The full check is abandoned after FULL_TEST_LOOKUPS table lookups; it can only
+//	confirm that small partitions are congruences, so there we rely on the rep check, which is
+//	equivalent to it by the argument given above.
+
+#define FULL_TEST_LOOKUPS 200000000
+
+bool checksAgree(int *cnum, int &partitions, int &fullDecided)
+{
+int nc = listClasses(cnum);
+int c1, c2;
+bool gen = findMismatch(CHECK_GEN,cnum,nc,0,c1,c2);
+bool rep = findMismatch(CHECK_REP,cnum,nc,0,c1,c2);
+
+fullCheckAborted = false;
+fullCheckLimit = tableLookups + FULL_TEST_LOOKUPS;
+bool full = findMismatch(CHECK_FULL,cnum,nc,0,c1,c2);
+fullCheckLimit = UINT64_MAX;
+
+partitions++;
+if (!fullCheckAborted) fullDecided++;
+if (gen!=rep || (!fullCheckAborted && gen!=full))
+	{
+	printf("Checks disagree on a partition with %d classes: gen=%d rep=%d full=%s\n",
+		classes.count,gen,rep,fullCheckAborted ? "undecided" : (full ? "1" : "0"));
+	return false;
+	};
+return true;
+}
+
+//	Test that the generator check is equivalent to the full check, on every partition met by
+//	a closure from the current classes, and on perturbations of the final congruence where two
+//	classes are merged or one element is split off into a class of its own.
+
+bool testCheckEquivalence()
+{
+checkVerbose = false;
+int *cnum = new int[nindex];
+int partitions = 0, fullDecided = 0;
+bool ok = true;
+
+while (ok)
+	{
+	int nc = listClasses(cnum);
+	int c1, c2;
+	bool found = findMismatch(CHECK_GEN,cnum,nc,0,c1,c2);
+	ok = checksAgree(cnum,partitions,fullDecided);
+	if (!found) break;
+	classes.merge(c1,c2);
+	};
+printf("Closure reached %d equivalence classes\n",classes.count);
+
+Index *saved = new Index[nindex];
+Index *root = new Index[nindex];
+for (int x=0;x<nindex;x++) saved[x] = classes.eqc[x];
+srand(1);
+
+for (int trial=0;ok && trial<100;trial++)
+	{
+	int nc = listClasses(cnum);
+	int i = rand()%nc, j = rand()%(nc-1);
+	if (j>=i) j++;
+	for (int x=0;x<nindex;x++) root[x] = (saved[x]==cnum[j]) ? cnum[i] : saved[x];
+	classes.setFromLabels(root);
+	ok = checksAgree(cnum,partitions,fullDecided);
+	classes.setFromLabels(saved);
+	};
+
+for (int trial=0;ok && trial<100;trial++)
+	{
+	Index x = rand()%nindex;
+	if (classes.size(saved[x])==1) continue;
+	for (int z=0;z<nindex;z++) root[z] = saved[z];
+	root[x] = classes.count;
+	classes.setFromLabels(root);
+	ok = checksAgree(cnum,partitions,fullDecided);
+	classes.setFromLabels(saved);
+	};
+
+if (ok) printf("Checks agreed on all %d partitions (full check decided %d of them)\n",partitions,fullDecided);
+
+delete [] root;
+delete [] saved;
+delete [] cnum;
+checkVerbose = true;
+return ok;
+}
+
+//	Stress test of the concurrent union-find: many threads make random unions at once, and the
+//	resulting sets must match those made by a sequential union-find from the same pairs.  The
+//	pairs mostly fall in a small range, so that threads often race to link the same roots.
+
+#define UF_TEST_ROUNDS 20
+#define UF_TEST_PAIRS 40000
+#define UF_TEST_THREADS 16
+
+bool testConcurrentUF()
+{
+Index *pairA = new Index[UF_TEST_PAIRS];
+Index *pairB = new Index[UF_TEST_PAIRS];
+Index *parent = new Index[nindex];
+ConcurrentUF *uf = new ConcurrentUF;
+int nthreads = std::max(UF_TEST_THREADS,numThreads);
+std::thread *pool = new std::thread[nthreads];
+bool ok = true;
+
+srandom(1);
+for (int round=0;ok && round<UF_TEST_ROUNDS;round++)
+	{
+	int range = (round%2==0) ? nindex : 512;
+	for (int k=0;k<UF_TEST_PAIRS;k++)
+		{
+		pairA[k] = (Index)(random()%range);
+		pairB[k] = (Index)(random()%nindex);
+		};
+		
+	//	Sequential union-find, with the same rule for choosing the root
+	
+	for (int x=0;x<nindex;x++) parent[x] = x;
+	for (int k=0;k<UF_TEST_PAIRS;k++)
+		{
+		Index x = pairA[k], y = pairB[k];
+		while (parent[x]!=x) x = parent[x];
+		while (parent[y]!=y) y = parent[y];
+		if (x!=y) parent[std::max(x,y)] = std::min(x,y);
+		};
+		
+	//	Concurrent union-find, with each thread taking every nthreads'th pair
+	
+	uf->reset(nindex);
+	std::atomic<int> links(0);
+	for (int t=0;t<nthreads;t++) pool[t] = std::thread([&,t]()
+		{
+		int n = 0;
+		for (int k=t;k<UF_TEST_PAIRS;k+=nthreads)
+			if (uf->unite(pairA[k],pairB[k])) n++;
+		links += n;
+		});
+	for (int t=0;t<nthreads;t++) pool[t].join();
+	
+	int seqLinks = 0;
+	for (int x=0;x<nindex;x++)
+		{
+		Index r = x;
+		while (parent[r]!=r) r = parent[r];
+		if (r!=x) seqLinks++;
+		if (uf->find(x)!=r)
+			{
+			printf("Round %d: element %d has root %d, but %d sequentially\n",round,x,uf->find(x),r);
+			ok = false;
+			break;
+			};
+		};
+	if (ok && links!=seqLinks)
+		{
+		printf("Round %d: %d links made, but %d sequentially\n",round,links.load(),seqLinks);
+		ok = false;
+		};
+	};
+	
+if (ok) printf("Concurrent union-find agreed with sequential union-find in %d rounds of %d unions on %d threads\n",
+	UF_TEST_ROUNDS,UF_TEST_PAIRS,nthreads);
+
+delete [] pool;
+delete uf;
+delete [] parent;
+delete [] pairB;
+delete [] pairA;
+return ok;
+}
+
+//	Union-find over the formal indices.  The root of each set is always its smallest
+//	member, so it is also the representative that outputEC lists for the class.
+
+Index ufParent[MAXINDEX];
+
+inline Index ufFind(Index x)
+{
+Index r = x;
+while (ufParent[r] != r) r = ufParent[r];
+while (ufParent[x] != r)
+	{
+	Index next = ufParent[x];
+	ufParent[x] = r;
+	x = next;
+	};
+return r;
+}
+
+//	Pairs of former roots that have been linked, but whose consequences under multiplication
+//	and addition have not yet been examined.  Every link removes a root, so there can never be
+//	more than nindex of these.
+
+Index ufPendA[MAXINDEX], ufPendB[MAXINDEX];
+int ufPendCount, ufLinks;
+
+inline void ufUnion(Index x, Index y)
+{
+Index rx = ufFind(x), ry = ufFind(y);
+if (rx==ry) return;
+if (rx<ry) ufParent[ry] = rx;
+else ufParent[rx] = ry;
+ufPendA[ufPendCount] = rx;
+ufPendB[ufPendCount] = ry;
+ufPendCount++;
+ufLinks++;
+}
+
+//	Rows or columns of the multiplication table, computed in bulk as needed when there is no
+//	MTAB.  The cache is two-way set associative, so the lines for both p and q of a link stay in
+//	it together, and the smaller, surviving root of one link is usually still there for the next.
+
+#define ROW_CACHE_SETS 64
+
+struct RowCache
+{
+bool right;
+Index *lines;
+int key[ROW_CACHE_SETS][2];
+int older[ROW_CACHE_SETS];
+uint64_t hits, misses;
+
+RowCache(bool r) : right(r), hits(0), misses(0)
+	{
+	lines = new Index[(size_t)2*ROW_CACHE_SETS*nindex];
+	for (int s=0;s<ROW_CACHE_SETS;s++)
+		{
+		key[s][0] = key[s][1] = -1;
+		older[s] = 0;
+		};
+	}
+~RowCache() { delete [] lines; }
+
+const Index *line(Index x)
+	{
+	int s = x % ROW_CACHE_SETS;
+	int w = key[s][0]==x ? 0 : key[s][1]==x ? 1 : -1;
+	if (w>=0) hits++;
+	else
+		{
+		w = older[s];
+		key[s][w] = x;
+		multRowAny(x,lines+(size_t)(2*s+w)*nindex,right);
+		misses++;
+		};
+	older[s] = 1-w;
+	return lines+(size_t)(2*s+w)*nindex;
+	}
+};
+
+//	Worklist congruence closure.
+//
+//	When the classes with roots p and q are linked, we need p*y ~ q*y, y*p ~ y*q and p+y ~ q+y
+//	for every y.  The tables are total, so the use list of a class is just the row and column
+//	of the multiplication table and the sums with its root, and each link only re-examines
+//	those 3*nindex entries.  Any two equivalent elements are joined by a chain of links whose
+//	consequences have all been examined, so once the worklist is empty the partition is a
+//	congruence.
+//
+//	If resuming is true, the classes and the worklist have been restored from a checkpoint, and
+//	the closure carries on from there; otherwise it starts by linking the current classes.
+//
+//	With useSymmetry, each link p ~ q taken from the worklist also links its images under the
+//	symmetries.  The congruence is invariant under them, so these links are all implied, and
+//	they go on the worklist like any others.
+
+void ufClosure(bool resuming)
+{
+for (int x=0;x<nindex;x++) ufParent[x] = x;
+ufLinks = 0;
+if (!resuming) ufPendCount = 0;
+
+Index *root = new Index[nindex];
+for (int c=0;c<classes.count;c++)
+	{
+	const Index *X = classes.classMembers(c);
+	for (int k=0;k<classes.size(c);k++)
+		{
+		if (resuming) ufParent[X[k]] = X[0];
+		else ufUnion(X[0],X[k]);
+		};
+	};
+int seedLinks = ufLinks;
+RowCache *rows = haveMTAB ? NULL : new RowCache(false);
+RowCache *cols = haveMTAB ? NULL : new RowCache(true);
+
+while (ufPendCount > 0)
+	{
+	if (checkpointDue())
+		{
+		for (int x=0;x<nindex;x++) root[x] = ufFind(x);
+		Partition *P = new Partition;
+		P->allocate();
+		P->setFromLabels(root);
+		saveCheckpoint(*P,ufPendA,ufPendB,ufPendCount,true);
+		delete P;
+		};
+	
+	ufPendCount--;
+	Index p = ufPendA[ufPendCount];
+	Index q = ufPendB[ufPendCount];
+	if (useSymmetry)
+		for (int s=0;s<nsym;s++) ufUnion(SYM[s][p],SYM[s][q]);
+	if (haveMTAB)
+		{
+		//	Walk the rows and columns of p and q directly, since nindex is not a constant
+
+		const Index *rowP = mtabRow(p), *rowQ = mtabRow(q), *col = MTAB;
+		for (int y=0;y<nindex;y++,col+=nindex)
+			{
+			ufUnion(rowP[y],rowQ[y]);
+			ufUnion(col[p],col[q]);
+			ufUnion(addIndices(p,y),addIndices(q,y));
+			};
+		}
+	else
+		{
+		const Index *rowP = rows->line(p), *rowQ = rows->line(q);
+		const Index *colP = cols->line(p), *colQ = cols->line(q);
+		for (int y=0;y<nindex;y++)
+			{
+			ufUnion(rowP[y],rowQ[y]);
+			ufUnion(colP[y],colQ[y]);
+			ufUnion(addIndices(p,y),addIndices(q,y));
+			};
+		};
+	tableLookups += 6*nindex;
+	};
+
+printf("Union-find closure: %d links from the initial classes, %d further links from congruence\n",seedLinks,ufLinks-seedLinks);
+if (!haveMTAB) printf("Row cache: %" PRIu64 " hits, %" PRIu64 " rows and columns computed\n",rows->hits+cols->hits,rows->misses+cols->misses);
+delete cols;
+delete rows;
+
+for (int x=0;x<nindex;x++) root[x] = ufFind(x);
+classes.setFromLabels(root);
+delete [] root;
+}
+
+//	Test the fast arithmetic exhaustively against the tuple arithmetic
+
+bool testArithmetic()
+{
+printf("Checking addIndices against addTuples for all pairs ...\n");
+for (int x1=0;x1<nindex;x1++)
+	{
+	int t1[MAXMONO];
+	indexToTuple(x1,t1);
+	for (int x2=0;x2<nindex;x2++)
+		{
+		int t2[MAXMONO], t12[MAXMONO];
+		indexToTuple(x2,t2);
+		addTuples(t1,t2,t12);
+		if (addIndices(x1,x2) != tupleToIndex(t12))
+			{
+			printf("addIndices failure for x1=%d, x2=%d\n",x1,x2);
+			return false;
+			};
+		};
+	};
+printf("Done\n\n");
+
+if (haveMTAB)
+	{
+	printf("Checking MTAB against multTuples for all pairs ...\n");
+	for (int x1=0;x1<nindex;x1++)
+		{
+		int t1[MAXMONO];
+		indexToTuple(x1,t1);
+		for (int x2=0;x2<nindex;x2++)
+			{
+			int t2[MAXMONO], t12[MAXMONO];
+			indexToTuple(x2,t2);
+			multTuples(t1,t2,t12);
+			if (mtabRow(x1)[x2] != tupleToIndex(t12))
+				{
+				printf("MTAB failure for x1=%d, x2=%d\n",x1,x2);
+				return false;
+				};
+			};
+		};
+	printf("Done\n\n");
+	};
+
+printf("Checking multIndices against %s for all pairs ...\n",haveMTAB ? "MTAB" : "multTuples");
+for (int x1=0;x1<nindex;x1++)
+for (int x2=0;x2<nindex;x2++)
+	{
+	Index expected = haveMTAB ? mtabRow(x1)[x2] : multIndicesByTuples(x1,x2);
+	if (multIndices(x1,x2) != expected)
+		{
+		printf("multIndices failure for x1=%d, x2=%d\n",x1,x2);
+		return false;
+		};
+	};
+printf("Done\n\n");
+
+printf("Checking the bit-sliced sums and products against addIndices and multIndices for all pairs ...\n");
+if (nindex<64 || !twoBitCoeffs) printf("Skipped, %s\n",twoBitCoeffs ? "fewer than 64 elements" : "coefficients are not 2 bits");
+else for (int x1=0;x1<nindex;x1++)
+	{
+	Slice s1, s2, sum, left, right;
+	Index vsum[64], vleft[64], vright[64];
+	sliceBroadcast(s1,x1);
+	for (int base=0;base<nindex;base+=64)
+		{
+		sliceRange(s2,base);
+		sliceAdd(s1,s2,sum);
+		sliceMult(s1,s2,left);
+		sliceMult(s2,s1,right);
+		sliceStore(sum,vsum);
+		sliceStore(left,vleft);
+		sliceStore(right,vright);
+		for (int k=0;k<64;k++)
+			{
+			Index x2 = base+k;
+			if (vsum[k]!=addIndices(x1,x2) || vleft[k]!=multIndices(x1,x2) || vright[k]!=multIndices(x2,x1))
+				{
+				printf("Bit-sliced arithmetic failure for x1=%d, x2=%d\n",x1,x2);
+				return false;
+				};
+			};
+		};
+	};
+printf("Done\n\n");
+
+if (kernels!=NULL)
+	{
+	printf("Checking the compiled kernels for %s with coefficients %d,%d against the tuple arithmetic\n"
+		"for all pairs ...\n",kernelMonoid,coeffK,coeffP);
+	Index *row = new Index[nindex], *column = new Index[nindex];
+	for (int x1=0;x1<nindex;x1++)
+		{
+		int t1[MAXMONO];
+		indexToTuple(x1,t1);
+		kernels->multRow(x1,row,false);
+		kernels->multRow(x1,column,true);
+		for (int x2=0;x2<nindex;x2++)
+			{
+			int t2[MAXMONO], t12[MAXMONO], c12[MAXMONO];
+			indexToTuple(x2,t2);
+			multTuples(t1,t2,t12);
+			kernels->multTuples(t1,t2,c12);
+			Index product = tupleToIndex(t12);
+			if (kernels->mult(x1,x2)!=product || tupleToIndex(c12)!=product || row[x2]!=product
+				|| column[x2]!=multIndicesByTuples(x2,x1) || kernels->add(x1,x2)!=addIndices(x1,x2))
+				{
+				printf("Compiled kernel failure for x1=%d, x2=%d\n",x1,x2);
+				delete [] column;
+				delete [] row;
+				return false;
+				};
+			};
+		};
+	delete [] column;
+	delete [] row;
+	printf("Done\n\n");
+	};
+return true;
+}
+
+//	Compare the throughput of MTAB lookups and factorized multiplication on random pairs
+
+#define BENCH_PAIRS (1<<24)
+
+void benchMultiplication()
+{
+Index *xs = new Index[BENCH_PAIRS];
+Index *ys = new Index[BENCH_PAIRS];
+srand(1);
+for (int k=0;k<BENCH_PAIRS;k++)
+	{
+	xs[k] = rand()%nindex;
+	ys[k] = rand()%nindex;
+	};
+
+Index chk1 = 0, chk2 = 0;
+if (haveMTAB)
+	{
+	double t0 = wallSeconds();
+	for (int k=0;k<BENCH_PAIRS;k++) chk1 ^= mtabRow(xs[k])[ys[k]];
+	double dt = wallSeconds()-t0;
+	printf("MTAB lookups:  %.1f million products/s\n",BENCH_PAIRS/dt*1e-6);
+	};
+
+Index (*compiled)(Index, Index) = compiledMult;
+compiledMult = NULL;
+double t0 = wallSeconds();
+for (int k=0;k<BENCH_PAIRS;k++) chk2 ^= multIndices(xs[k],ys[k]);
+double dt = wallSeconds()-t0;
+compiledMult = compiled;
+printf("multIndices:   %.1f million products/s\n",BENCH_PAIRS/dt*1e-6);
+if (haveMTAB && chk1!=chk2) printf("Checksums differ: %d %d\n",chk1,chk2);
+
+//	The compiled kernels, called through the pointers in kernels as elsewhere, and the rows
+//	they fill against those filled by multRowAny without them
+
+if (kernels!=NULL)
+	{
+	Index chk4 = 0;
+	t0 = wallSeconds();
+	for (int k=0;k<BENCH_PAIRS;k++) chk4 ^= kernels->mult(xs[k],ys[k]);
+	dt = wallSeconds()-t0;
+	printf("Rig<%s>::mult:    %.1f million products/s\n",kernelMonoid,BENCH_PAIRS/dt*1e-6);
+	if (chk4!=chk2) printf("Checksums differ: %d %d\n",chk2,chk4);
+	
+	Index *row = new Index[nindex];
+	int nrows = std::max(1,BENCH_PAIRS/nindex);
+	Index chk5 = 0, chk6 = 0;
+	t0 = wallSeconds();
+	for (int r=0;r<nrows;r++)
+		{
+		kernels->multRow(xs[r],row,false);
+		chk5 ^= row[ys[r]];
+		};
+	dt = wallSeconds()-t0;
+	printf("Rig<%s>::multRow: %.1f million products/s\n",kernelMonoid,(double)nrows*nindex/dt*1e-6);
+	const RigKernels *compiledRows = kernels;
+	kernels = NULL;
+	t0 = wallSeconds();
+	for (int r=0;r<nrows;r++)
+		{
+		multRowAny(xs[r],row,false);
+		chk6 ^= row[ys[r]];
+		};
+	dt = wallSeconds()-t0;
+	kernels = compiledRows;
+	printf("multRowAny:    %.1f million products/s, without the compiled kernels%s\n",(double)nrows*nindex/dt*1e-6,
+		avx2Rows ? " (AVX2)" : twoBitCoeffs ? " (bit-sliced)" : " (monomial actions)");
+	if (chk5!=chk6) printf("Checksums differ: %d %d\n",chk5,chk6);
+	delete [] row;
+	};
+
+//	The slices need 2-bit coefficients
+
+if (!twoBitCoeffs)
+	{
+	printf("\n");
+	delete [] ys;
+	delete [] xs;
+	return;
+	};
+
+Index chk3 = 0;
+Index prod[64];
+t0 = wallSeconds();
+for (int k=0;k<BENCH_PAIRS;k+=64)
+	{
+	Slice sx, sy, sp;
+	sliceLoad(sx,xs+k);
+	sliceLoad(sy,ys+k);
+	sliceMult(sx,sy,sp);
+	sliceStore(sp,prod);
+	for (int j=0;j<64;j++) chk3 ^= prod[j];
+	};
+dt = wallSeconds()-t0;
+printf("sliceMult:     %.1f million products/s, including loading and storing\n",BENCH_PAIRS/dt*1e-6);
+
+Slice sx, sy, sp;
+sliceLoad(sx,xs);
+sliceLoad(sy,ys);
+t0 = wallSeconds();
+for (int k=0;k<BENCH_PAIRS;k+=64)
+	{
+	sliceMult(sx,sy,sp);
+	sx.lo[0] ^= sp.lo[1];
+	};
+dt = wallSeconds()-t0;
+printf("sliceMult:     %.1f million products/s, on slices alone (%d)\n",BENCH_PAIRS/dt*1e-6,(int)(sx.lo[0]&1));
+if (chk3!=chk2) printf("Checksums differ: %d %d\n",chk2,chk3);
+printf("\n");
+
+delete [] ys;
+delete [] xs;
+}
+
+//	Put each of the nindex formal elements into an equivalence class based on its square
+
+void seedFromSquares()
+{
+//	Label each element by its square
+//
+//	If x^2 = y^2, then x = x^2 = y^2 = y
+
+Index *label = new Index[nindex];
+int *size = new int[nindex];
+for (int k=0;k<nindex;k++) size[k] = 0;
+
+//	The labels in use, most recently created first
+
+int *visit = new int[nindex];
+int count = 0;
+for (int x=0;x<nindex;x++)
+	{
+	Index sq = multiply(x,x);
+	label[x] = sq;
+	if (size[sq]++ == 0) visit[count++] = sq;
+	};
+std::reverse(visit,visit+count);
+int nvisit = count;
+	
+printf("Initially created %d equivalence classes based on elements having the same square\n",count);
+
+//	Modify the equivalence classes, so that x^2 itself is always in the equivalence class labelled by x^2, rather than (x^2)^2 if that is formally different
+
+for (int pass=0;pass<2;pass++)
+	{
+	int ec=0, nic=0, elc=0;
+	for (int v=0;v<nvisit;v++)
+		{
+		int ePtr = visit[v];
+		if (size[ePtr]==0) continue;
+		ec++;
+		if (pass==1) elc += size[ePtr];
+		int ecl = label[ePtr];
+		if (ecl != ePtr)
+			{
+			nic++;
+			
+			//	Merge the ecl class into the ePtr class
+			
+			for (int z=0;z<nindex;z++)
+				if (label[z]==ecl) label[z] = ePtr;
+			size[ePtr] += size[ecl];
+			size[ecl] = 0;
+			count--;
+			};
+		};
+	printf("Equivalence classes checked = %d, those where x^2 not in own class = %d\n",ec,nic);
+	printf("We now have %d equivalence classes\n",count);
+	if (pass==1) printf("Total elements counted is %d\n",elc);
+	};
+
+classes.setFromLabels(label);
+
+delete [] visit;
+delete [] size;
+delete [] label;
+}
+
+//	Merge the classes using the squares of all sums: (x+y)^2 = x^2+xy+yx+y^2, so with x~x^2 and
+//	y~y^2 we have x+y ~ x+xy+yx+y for every pair.  The pairs are shared between the worker
+//	threads a block of rows at a time, and the merges recorded in a concurrent union-find.
+
+void seedFromSums()
+{
+double t0 = wallSeconds();
+int before = classes.count;
+ConcurrentUF *uf = new ConcurrentUF;
+uf->reset(nindex);
+for (int x=0;x<nindex;x++) uf->unite(x,classes.classMembers(classes.eqc[x])[0]);
+
+std::atomic<int> links(0);
+parallelBlocks(nindex,64,[&](int start, int end)
+	{
+	int n = 0;
+	for (int x=start;x<end;x++)
+	for (int y=x;y<nindex;y++)
+		{
+		Index s = addIndices(x,y);
+		Index t = addIndices(s,addIndices(multiply(x,y),multiply(y,x)));
+		if (s!=t && uf->unite(s,t)) n++;
+		};
+	links += n;
+	});
+tableLookups += (uint64_t)nindex*(nindex+1);
+
+Index *label = new Index[nindex];
+for (int x=0;x<nindex;x++) label[x] = uf->find(x);
+classes.setFromLabels(label);
+delete [] label;
+delete uf;
+
+printf("Squares of sums merged %d equivalence classes into %d, took %.3f s\n\n",before,classes.count,wallSeconds()-t0);
+}
+
+//	Read off the rule for the integers that the closure arrived at, rather than the one it was
+//	given, from the class of each integer 0 .. nvalue-1.  If c is the first integer equivalent
+//	to a smaller one, k, then 0 .. c-1 are distinct and adding 1 to both sides gives every
+//	d >= c equivalent to d-(c-k), so the integers collapse by the rule with K = k, P = c-k.
+
+void findCoeffCollapse(const int *integerClass, int &k, int &p)
+{
+int c = nvalue;
+k = coeffK;
+for (int d=1;d<nvalue && c==nvalue;d++)
+for (int j=0;j<d;j++)
+	if (integerClass[d]==integerClass[j])
+		{
+		k = j;
+		c = d;
+		break;
+		};
+p = c==nvalue ? coeffP : c-k;
+if (c<nvalue) printf("The closure identifies %d = %d, so the coefficients collapse by the rule %d,%d\n",c,k,k,p);
+else printf("The closure identifies no integers below %d, so the coefficients only collapse by the rule %d,%d\n",nvalue,k,p);
+}
+
+//	Reduce the coefficients of a tuple by the rule K = k, P = p
+
+void reduceTuple(int *tuple, int k, int p)
+{
+for (int i=0;i<nmono;i++) if (tuple[i]>=k+p) tuple[i] = k+(tuple[i]-k)%p;
+}
+
+void reportDerivedRule(int k, int p)
+{
+printf("Every element is equivalent to its coefficients reduced by that rule, so this is the rig for --coeffs=%d,%d%s\n\n",
+	k,p,k==2 && p==2 ? ",\nconfirming the default rule 4 = 2" : "");
+}
+
+//	Every formal element should be equivalent to its coefficients reduced by the derived rule,
+//	so that the quotient is the rig for --coeffs=K,P
+
+bool deriveCoeffRule()
+{
+int *integerClass = new int[nvalue], k, p;
+for (int c=0;c<nvalue;c++) integerClass[c] = classes.eqc[c];
+findCoeffCollapse(integerClass,k,p);
+delete [] integerClass;
+
+int tuple[MAXMONO];
+for (int x=0;x<nindex;x++)
+	{
+	indexToTuple(x,tuple);
+	reduceTuple(tuple,k,p);
+	Index r = tupleToIndex(tuple);
+	if (classes.eqc[r]!=classes.eqc[x])
+		{
+		printf("But ");
+		printIndex(stdout,x,false);
+		printf(" is not equivalent to ");
+		printIndex(stdout,r,false);
+		printf("\n\n");
+		return false;
+		};
+	};
+reportDerivedRule(k,p);
+return true;
+}
+
+//	Sparse engine, for monoids with too many monomials for a 16-bit index.
+//
+//	A formal element is packed into a Word with each coefficient in a bit field just wide enough
+//	for nvalue values, and Word is uint32_t, uint64_t or unsigned __int128, whichever is the
+//	smallest that holds them all.
+//
+//	Rather than closing the formal elements themselves, the engine enumerates the classes, as
+//	Todd-Coxeter coset enumeration does for the cosets of a subgroup.  Each node stands for a
+//	class, with a formal element as its representative, hash-consed in an open-addressing table
+//	so that no two nodes have the same one, and a row of transitions under the unary maps g*x,
+//	x*g and x+m of setupUnaryMaps, filled in as needed.  The formal elements are presented by 0
+//	with the relations x+m+m' = x+m'+m, x plus nvalue m's = x plus coeffK m's, g*(x+m) = g*x+gm,
+//	(x+m)*g = x*g+mg and g*0 = 0*g = 0.  The nodes are scanned in order, and each one is checked
+//	against all of these and against r*r ~ r for its representative r, with r*r reached from
+//	node 0 by the maps x+m.  Nodes found to be equal are merged, along with their rows, which
+//	stores nothing new, so only the classes and a few nodes besides are ever stored.
+
+#define SPARSE_MAX_VALUES 256			//	so that the sums in a product can't overflow
+#define SPARSE_CHECK_ALL (1 << 20)
+#define SPARSE_CHECK_SAMPLES (1 << 16)
+#define SPARSE_PROGRESS (1 << 20)
+#define SPARSE_NONE UINT32_MAX
+
+//	The limit on the nodes stored, from --max-elements, or 0 for the default: SPARSE_MAX_NODES,
+//	or fewer when their rows of transitions, which grow with the number of maps, would not fit
+//	in SPARSE_MAX_BYTES.  The arrays double as they grow, hence the factor 2 in the budget.
+
+#define SPARSE_MAX_NODES (1u << 23)
+#define SPARSE_MAX_BYTES ((size_t)1 << 31)
+
+uint32_t sparseMaxElements = 0;
+
+inline uint64_t wordHigh(uint32_t) { return 0; }
+inline uint64_t wordHigh(uint64_t) { return 0; }
+#ifdef __SIZEOF_INT128__
+inline uint64_t wordHigh(unsigned __int128 w) { return (uint64_t)(w >> 64); }
+#endif
+
+template <typename Word>
+struct SparseRig
+{
+int bits;				//	bits per coefficient
+Word lo;				//	the low bit of every coefficient
+int numMaps;
+uint32_t count, capacity, merges;
+Word *elem;				//	the representative of each node
+uint32_t *parent;		//	union-find over the nodes; each live node is the smallest in its set
+uint32_t *trans;		//	numMaps transitions for each node, or SPARSE_NONE
+uint32_t *pendA, *pendB, npending, pendCapacity;
+uint32_t *slot;			//	the hash table, holding node+1, or 0 for an empty slot
+int slotBits;
+
+SparseRig(int b) : bits(b), lo(0), numMaps(2*ngens+nmono), count(0), capacity(0), merges(0),
+	elem(NULL), parent(NULL), trans(NULL), pendA(NULL), pendB(NULL), npending(0), pendCapacity(0),
+	slot(NULL), slotBits(0)
+	{
+	for (int i=0;i<nmono;i++) lo |= (Word)1 << (bits*i);
+	grow();
+	}
+~SparseRig()
+	{
+	delete [] elem;
+	delete [] parent;
+	delete [] trans;
+	delete [] pendA;
+	delete [] pendB;
+	delete [] slot;
+	}
+
+//	The map x+m
+
+int plus(int m) const { return 2*ngens+m; }
+
+Word mono(int m) const { return (Word)1 << (bits*m); }
+
+void toTuple(Word w, int *t) const
+	{
+	Word mask = ((Word)1 << bits) - 1;
+	for (int i=0;i<nmono;i++,w>>=bits) t[i] = (int)(w & mask);
+	}
+
+Word fromTuple(const int *t) const
+	{
+	Word w = 0;
+	for (int i=nmono-1;i>=0;i--) w = (w << bits) | (Word)t[i];
+	return w;
+	}
+
+Word add(Word x, Word y) const
+	{
+	if (twoBitCoeffs) return ((x ^ y) & lo) | ((x | y | ((x & y & lo) << 1)) & (lo << 1));
+	int t1[MAXSPARSEMONO], t2[MAXSPARSEMONO];
+	toTuple(x,t1);
+	toTuple(y,t2);
+	for (int i=0;i<nmono;i++) t1[i] = normCoeff(t1[i]+t2[i]);
+	return fromTuple(t1);
+	}
+
+Word mult(Word x, Word y) const
+	{
+	int t1[MAXSPARSEMONO], t2[MAXSPARSEMONO], t12[MAXSPARSEMONO];
+	toTuple(x,t1);
+	toTuple(y,t2);
+	for (int k=0;k<nmono;k++) t12[k] = 0;
+	for (int i=0;i<nmono;i++)
+	if (t1[i]!=0)
+	for (int j=0;j<nmono;j++) t12[mtab[i][j]] += t1[i]*t2[j];
+	for (int k=0;k<nmono;k++) t12[k] = normCoeff(t12[k]);
+	return fromTuple(t12);
+	}
+
+//	The unary maps in the order of setupUnaryMaps: g*x and x*g for each generator, then x+m
+
+Word apply(int u, Word x) const
+	{
+	if (u>=2*ngens) return add(x,mono(u-2*ngens));
+	int g = gens[u/2], t[MAXSPARSEMONO], r[MAXSPARSEMONO];
+	toTuple(x,t);
+	for (int k=0;k<nmono;k++) r[k] = 0;
+	for (int k=0;k<nmono;k++) r[u%2==0 ? mtab[g][k] : mtab[k][g]] += t[k];
+	for (int k=0;k<nmono;k++) r[k] = normCoeff(r[k]);
+	return fromTuple(r);
+	}
+
+size_t home(Word w) const
+	{
+	uint64_t h = ((uint64_t)w ^ wordHigh(w)*0xC2B2AE3D27D4EB4FULL) * 0x9E3779B97F4A7C15ULL;
+	return (size_t)(h >> (64-slotBits));
+	}
+
+//	The memory for each node: its representative, parent and row, and two hash slots
+
+size_t nodeBytes() const
+	{
+	return sizeof(Word) + (3+(size_t)numMaps)*sizeof(uint32_t);
+	}
+
+//	Double the capacity, and rehash every node into a table twice that size
+
+void grow()
+	{
+	uint32_t cap = capacity==0 ? (1u << 16) : 2*capacity;
+	Word *e = cap>capacity ? new (std::nothrow) Word[cap] : NULL;
+	uint32_t *par = e!=NULL ? new (std::nothrow) uint32_t[cap] : NULL;
+	uint32_t *tr = par!=NULL ? new (std::nothrow) uint32_t[(size_t)cap*numMaps] : NULL;
+	if (tr==NULL)
+		{
+		printf("Out of memory growing the sparse engine to %u nodes of %zu bytes; use --max-elements\n"
+			"to stop it sooner\n",cap,nodeBytes());
+		exit(EXIT_FAILURE);
+		};
+	if (count>0)
+		{
+		memcpy(e,elem,count*sizeof(Word));
+		memcpy(par,parent,count*sizeof(uint32_t));
+		memcpy(tr,trans,(size_t)count*numMaps*sizeof(uint32_t));
+		};
+	delete [] elem;
+	delete [] parent;
+	delete [] trans;
+	elem = e;
+	parent = par;
+	trans = tr;
+	capacity = cap;
+	
+	delete [] slot;
+	slotBits = 1;
+	while (((size_t)1 << slotBits) < 2*(size_t)cap) slotBits++;
+	size_t mask = ((size_t)1 << slotBits) - 1;
+	slot = new uint32_t[mask+1];
+	memset(slot,0,(mask+1)*sizeof(uint32_t));
+	for (uint32_t id=0;id<count;id++)
+		{
+		size_t i = home(elem[id]);
+		while (slot[i]!=0) i = (i+1) & mask;
+		slot[i] = id+1;
+		};
+	}
+
+uint32_t find(uint32_t x)
+	{
+	while (parent[x]!=x)
+		{
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+		};
+	return x;
+	}
+
+//	The live node for a formal element, creating one if no node has it as representative
+
+uint32_t intern(Word w)
+	{
+	if (count==capacity) grow();
+	size_t mask = ((size_t)1 << slotBits) - 1;
+	size_t i = home(w);
+	for (;slot[i]!=0;i=(i+1) & mask)
+		if (elem[slot[i]-1]==w) return find(slot[i]-1);
+	elem[count] = w;
+	parent[count] = count;
+	for (int u=0;u<numMaps;u++) trans[(size_t)count*numMaps+u] = SPARSE_NONE;
+	slot[i] = count+1;
+	return count++;
+	}
+
+//	The image of live node c under map u, defining it if need be
+
+uint32_t follow(uint32_t c, int u)
+	{
+	uint32_t t = trans[(size_t)c*numMaps+u];
+	if (t==SPARSE_NONE)
+		{
+		t = intern(apply(u,elem[c]));
+		trans[(size_t)c*numMaps+u] = t;
+		};
+	return find(t);
+	}
+
+//	The node for a formal element, reached from node 0 by the maps x+m, defining the nodes on
+//	the way if define is true, or SPARSE_NONE if one is missing
+
+uint32_t trace(Word f, bool define)
+	{
+	int t[MAXSPARSEMONO];
+	toTuple(f,t);
+	uint32_t c = find(0);
+	for (int m=0;m<nmono;m++)
+	for (int j=0;j<t[m];j++)
+		{
+		if (define) c = follow(c,plus(m));
+		else
+			{
+			uint32_t next = trans[(size_t)c*numMaps+plus(m)];
+			if (next==SPARSE_NONE) return SPARSE_NONE;
+			c = find(next);
+			};
+		};
+	return c;
+	}
+
+void pushCoincidence(uint32_t a, uint32_t b)
+	{
+	if (npending==pendCapacity)
+		{
+		uint32_t cap = pendCapacity==0 ? 1024 : 2*pendCapacity;
+		uint32_t *pa = new uint32_t[cap], *pb = new uint32_t[cap];
+		memcpy(pa,pendA,npending*sizeof(uint32_t));
+		memcpy(pb,pendB,npending*sizeof(uint32_t));
+		delete [] pendA;
+		delete [] pendB;
+		pendA = pa;
+		pendB = pb;
+		pendCapacity = cap;
+		};
+	pendA[npending] = a;
+	pendB[npending] = b;
+	npending++;
+	}
+
+//	Merge two nodes, and all the nodes that their rows then show must be merged
+
+void coincide(uint32_t a, uint32_t b)
+	{
+	pushCoincidence(a,b);
+	while (npending>0)
+		{
+		npending--;
+		uint32_t r = find(pendA[npending]), s = find(pendB[npending]);
+		if (r==s) continue;
+		if (r>s) std::swap(r,s);
+		parent[s] = r;
+		merges++;
+		uint32_t *rowR = trans+(size_t)r*numMaps, *rowS = trans+(size_t)s*numMaps;
+		for (int u=0;u<numMaps;u++)
+		if (rowS[u]!=SPARSE_NONE)
+			{
+			if (rowR[u]==SPARSE_NONE) rowR[u] = rowS[u];
+			else pushCoincidence(rowR[u],rowS[u]);
+			};
+		};
+	}
+
+//	Check live node c against every relation, stopping if it is merged into an earlier node
+
+void scan(uint32_t c)
+	{
+	if (c==0) for (int u=0;u<2*ngens;u++) coincide(follow(0,u),0);
+	for (int m1=0;m1<nmono;m1++)
+	for (int m2=m1+1;m2<nmono;m2++)
+		{
+		if (find(c)!=c) return;
+		uint32_t a = follow(follow(c,plus(m1)),plus(m2));
+		coincide(a,follow(follow(c,plus(m2)),plus(m1)));
+		};
+	for (int m=0;m<nmono;m++)
+		{
+		if (find(c)!=c) return;
+		uint32_t a = c;
+		for (int k=0;k<coeffK;k++) a = follow(a,plus(m));
+		uint32_t b = a;
+		for (int k=0;k<coeffP;k++) b = follow(b,plus(m));
+		coincide(a,b);
+		};
+	for (int g=0;g<ngens;g++)
+	for (int m=0;m<nmono;m++)
+		{
+		if (find(c)!=c) return;
+		uint32_t a = follow(follow(c,plus(m)),2*g);
+		coincide(a,follow(follow(c,2*g),plus(mtab[gens[g]][m])));
+		if (find(c)!=c) return;
+		a = follow(follow(c,plus(m)),2*g+1);
+		coincide(a,follow(follow(c,2*g+1),plus(mtab[m][gens[g]])));
+		};
+	if (find(c)!=c) return;
+	Word r = elem[c];
+	coincide(c,trace(mult(r,r),true));
+	}
 
-int passCount = 0;
-while (true)
+bool run(uint32_t maxElements)
 	{
-	bool didMerge = false;
-	int c1 = -1, c2 =-1;
+	double t0 = wallSeconds();
+	intern((Word)0);
+	for (uint32_t c=0;c<count;c++)
+		{
+		if (find(c)==c) scan(c);
+		if (count>maxElements)
+			{
+			printf("Stopped with %u nodes stored and %u classes, over the limit of --max-elements=%u\n",
+				count,count-merges,maxElements);
+			return false;
+			};
+		if ((c+1)%SPARSE_PROGRESS==0)
+			printf("  %u nodes scanned, %u stored, %u classes so far\n",c+1,count,count-merges);
+		};
+	printf("Sparse closure: %u nodes stored, %u merged, %u classes, took %.3f s\n\n",count,merges,count-merges,wallSeconds()-t0);
+	return true;
+	}
+
+//	The class of any formal element
+
+uint32_t classOf(Word f)
+	{
+	return trace(f,false);
+	}
+
+void print(FILE *fp, Word w) const
+	{
+	int t[MAXSPARSEMONO];
+	toTuple(w,t);
+	printTuple(fp,t,false);
+	}
+
+//	Formal element number s, for checking every one, or a random one
+
+Word formal(uint64_t s) const
+	{
+	int t[MAXSPARSEMONO];
+	for (int i=0;i<nmono;i++,s/=nvalue) t[i] = (int)(s%nvalue);
+	return fromTuple(t);
+	}
+
+Word randomFormal() const
+	{
+	int t[MAXSPARSEMONO];
+	for (int i=0;i<nmono;i++) t[i] = (int)(random64()%nvalue);
+	return fromTuple(t);
+	}
+
+//	The elements to check: all of them when there are few enough, otherwise random samples
+
+uint64_t checkCount(bool &all) const
+	{
+	uint64_t total = 1;
+	for (int i=0;i<nmono && total<=SPARSE_CHECK_ALL;i++) total *= nvalue;
+	all = total<=SPARSE_CHECK_ALL;
+	return all ? total : SPARSE_CHECK_SAMPLES;
+	}
+
+//	Check that x*x ~ x, and that products and sums with a random element only depend on the
+//	classes, for every formal element or a sample of them
+
+bool check()
+	{
+	bool all;
+	uint64_t n = checkCount(all);
+	for (uint64_t s=0;s<n;s++)
+		{
+		Word f = all ? formal(s) : randomFormal(), g = randomFormal();
+		uint32_t cf = classOf(f), cg = classOf(g);
+		bool ok = cf!=SPARSE_NONE && cg!=SPARSE_NONE && classOf(mult(f,f))==cf
+			&& classOf(mult(f,g))==classOf(mult(elem[cf],elem[cg]))
+			&& classOf(mult(g,f))==classOf(mult(elem[cg],elem[cf]))
+			&& classOf(add(f,g))==classOf(add(elem[cf],elem[cg]));
+		if (!ok)
+			{
+			printf("The classes are not a congruence with x*x ~ x: check failed for x = ");
+			print(stdout,f);
+			printf(", y = ");
+			print(stdout,g);
+			printf("\n");
+			return false;
+			};
+		};
+	printf("Checked x*x ~ x, and that x*y, y*x and x+y only depend on the classes, for %s%" PRIu64 " elements x\n\n",
+		all ? "all " : "",n);
+	return true;
+	}
+
+//	As deriveCoeffRule, checking the reduction on all formal elements or a sample of them
+
+bool deriveRule()
+	{
+	int *integerClass = new int[nvalue], k, p;
+	for (int c=0;c<nvalue;c++) integerClass[c] = (int)classOf((Word)c);
+	findCoeffCollapse(integerClass,k,p);
+	delete [] integerClass;
 	
-	int ePtrX = firstLL;
-	int nc = 0;
-	while (ePtrX >= 0)
+	bool all;
+	uint64_t n = checkCount(all);
+	for (uint64_t s=0;s<n;s++)
+		{
+		Word f = all ? formal(s) : randomFormal();
+		int t[MAXSPARSEMONO];
+		toTuple(f,t);
+		reduceTuple(t,k,p);
+		if (classOf(f)!=classOf(fromTuple(t)))
+			{
+			printf("But ");
+			print(stdout,f);
+			printf(" is not equivalent to ");
+			printTuple(stdout,t,false);
+			printf("\n\n");
+			return false;
+			};
+		};
+	reportDerivedRule(k,p);
+	return true;
+	}
+
+//	Write the smallest stored element of each class to the output file, in increasing order
+
+void writeRepresentatives()
+	{
+	uint32_t nc = count-merges;
+	Word *rep = new Word[nc];
+	uint32_t *cnum = new uint32_t[count];
+	nc = 0;
+	for (uint32_t id=0;id<count;id++)
 		{
-		cnum[nc++] = ePtrX;
-		ePtrX = LL[ePtrX].next;
+		uint32_t r = find(id);
+		if (r==id)
+			{
+			cnum[id] = nc;
+			rep[nc++] = elem[id];
+			}
+		else
+			{
+			cnum[id] = cnum[r];
+			if (elem[id]<rep[cnum[r]]) rep[cnum[r]] = elem[id];
+			};
 		};
-	qsort(cnum,nc,sizeof(cnum[0]),ecmp);
-		
-	for (int outerCount=0;outerCount<nc;outerCount++)
+	std::sort(rep,rep+nc);
+	
+	char tmp[TEMP_NAME_LEN];
+	FILE *fp = openTemp(OUTPUT_FILE,"wt",tmp);
+	if (fp==NULL) printf("Error opening output file %s to write\n",tmp);
+	else
 		{
-		ePtrX = cnum[outerCount];
-		
-		printf("passCount = %d, outerCount = %d / %d, elements = %d\n",passCount, outerCount+1,countLL,LL[ePtrX].count);
+		fprintf(fp,"{");
+		for (uint32_t c=0;c<nc;c++)
+			{
+			if (c!=0) fprintf(fp,",\n");
+			print(fp,rep[c]);
+			};
+		fprintf(fp,"}\n");
+		if (!commitTemp(fp,tmp,OUTPUT_FILE)) printf("Error writing output file %s\n",OUTPUT_FILE);
+		};
+	delete [] cnum;
+	delete [] rep;
+	}
+};
+
+template <typename Word>
+bool sparseClosureWith(int bits, bool derive)
+{
+SparseRig<Word> *R = new SparseRig<Word>(bits);
+uint32_t limit = sparseMaxElements;
+if (limit==0)
+	{
+	limit = (uint32_t)std::min((size_t)SPARSE_MAX_NODES,SPARSE_MAX_BYTES/(2*R->nodeBytes()));
+	if (limit<SPARSE_MAX_NODES)
+		printf("Storing at most %u nodes of %zu bytes, to stay within %zu MB\n\n",limit,R->nodeBytes(),SPARSE_MAX_BYTES >> 20);
+	};
+bool ok = R->run(limit) && R->check();
+bool derived = ok && (!derive || R->deriveRule());
+if (ok)
+	{
+	R->writeRepresentatives();
+	printf("We now have %u equivalence classes\n",R->count-R->merges);
+	};
+delete R;
+return ok && derived;
+}
+
+bool sparseClosure(bool derive)
+{
+int bits = 1;
+while ((1 << bits) < nvalue) bits++;
+findGenerators();
+printf("Sparse engine: %d bits for each of %d coefficients, generating unary maps:",bits,nmono);
+for (int g=0;g<ngens;g++) printf(" %s*x x*%s",mtext[gens[g]],mtext[gens[g]]);
+for (int m=0;m<nmono;m++) printf(" x+%s",mtext[m]);
+printf("\n\n");
+
+if (bits*nmono<=32) return sparseClosureWith<uint32_t>(bits,derive);
+if (bits*nmono<=64) return sparseClosureWith<uint64_t>(bits,derive);
+#ifdef __SIZEOF_INT128__
+if (bits*nmono<=128) return sparseClosureWith<unsigned __int128>(bits,derive);
+#endif
+printf("%d monomials with %d bits per coefficient don't fit in the widest word\n",nmono,bits);
+return false;
+}
+
+//	Expression normalizer.
+//
+//	Each line of input is an expression in the monomials, with +, juxtaposition for products,
+//	parentheses and integers, as printed by printTuple, e.g. 2+ab(1+a)b.  Names are matched
+//	longest first, so aba is a single monomial, and abab is aba*b.  The expression is
+//	evaluated on the tables of a rig file as it is parsed, and its element printed as the
+//	representative, in the same form.  Lines that can't be parsed give "? message at column N".
+
+#define NORMALIZE_CHUNK (1<<24)
+#define NORMALIZE_MAX_DEPTH 1000
+
+struct Normalizer
+{
+const RigFile *rf;
+const char *line, *p, *end;
+const char *error, *errorAt;
+int depth;
+
+void skipSpace()
+	{
+	while (p<end && (*p==' ' || *p=='\t' || *p=='\r')) p++;
+	};
+	
+bool startsFactor()
+	{
+	return p<end && ((*p>='0' && *p<='9') || *p=='(' || (*p>='a' && *p<='z') || (*p>='A' && *p<='Z'));
+	};
+	
+uint16_t fail(const char *message)
+	{
+	if (error==NULL)
+		{
+		error = message;
+		errorAt = p;
+		};
+	p = end;
+	return 0;
+	};
+	
+uint16_t factor()
+	{
+	skipSpace();
+	if (p>=end) return fail("expression ends early");
+	if (*p>='0' && *p<='9')
+		{
+		//	The reduction of coefficients respects sums and products, so n can be kept
+		//	reduced as the digits are read
 		
-		for (int k1=0;k1<LL[ePtrX].count;k1++)
+		uint32_t n = 0;
+		while (p<end && *p>='0' && *p<='9')
+			{
+			uint32_t d = (uint32_t)(*p++ - '0');
+			n = rigCoeff(*rf,n*10+d);
+			};
+		return rigInteger(*rf,n);
+		};
+	if (*p=='(')
+		{
+		p++;
+		if (++depth > NORMALIZE_MAX_DEPTH) return fail("too deeply nested");
+		uint16_t v = expr();
+		depth--;
+		skipSpace();
+		if (p>=end || *p!=')') return fail("missing )");
+		p++;
+		return v;
+		};
+	int best = -1;
+	size_t bestLen = 0;
+	for (uint32_t m=0;m<rf->nmono;m++)
+		{
+		const char *name = rigMonomialName(*rf,m);
+		size_t len = strlen(name);
+		if (len>bestLen && !(name[0]>='0' && name[0]<='9') && (size_t)(end-p)>=len && memcmp(p,name,len)==0)
+			{
+			best = m;
+			bestLen = len;
+			};
+		};
+	if (best<0) return fail(startsFactor() ? "unknown name" : "unexpected character");
+	p += bestLen;
+	return rigMonomial(*rf,best);
+	};
+	
+uint16_t term()
+	{
+	uint16_t v = factor();
+	skipSpace();
+	while (startsFactor())
+		{
+		v = rigMul(*rf,v,factor());
+		skipSpace();
+		};
+	return v;
+	};
+	
+uint16_t expr()
+	{
+	uint16_t v = term();
+	skipSpace();
+	while (p<end && *p=='+')
+		{
+		p++;
+		v = rigAdd(*rf,v,term());
+		skipSpace();
+		};
+	return v;
+	};
+	
+//	Normalize the lines in [start, stop), appending the results to out, which must have room
+	
+char *normalizeLines(const char *start, const char *stop, char *out, char **repText, size_t *repLen)
+	{
+	while (start<stop)
+		{
+		const char *eol = (const char *)memchr(start,'\n',stop-start);
+		if (eol==NULL) eol = stop;
+		line = p = start;
+		end = eol;
+		error = NULL;
+		depth = 0;
+		skipSpace();
+		if (p<end)
 			{
-			Index x1 = LL[ePtrX].elements[k1];
-			for (int k2=0;k2<LL[ePtrX].count;k2++)
+			uint16_t v = expr();
+			if (error==NULL && p<end) fail(*p==')' ? "unmatched )" : "unexpected character");
+			if (error==NULL)
 				{
-				Index x2 = LL[ePtrX].elements[k2];
-				
-				int ePtrY = firstLL;
-				while (ePtrY >= 0)
-					{
-					for (int q1=0;q1<LL[ePtrY].count;q1++)
-						{
-						Index y1 = LL[ePtrY].elements[q1];
-						for (int q2=0;q2<LL[ePtrY].count;q2++)
-							{
-							Index y2 = LL[ePtrY].elements[q2];
-							
-							c1 = eqc[MTAB[x1][y1]];
-							c2 = eqc[MTAB[x2][y2]];
-							if (c1!=c2) goto done;
-
-							c1 = eqc[ATAB[x1][y1]];
-							c2 = eqc[ATAB[x2][y2]];
-							if (c1!=c2) goto done;
-							};
-						};
-					ePtrY = LL[ePtrY].next;
-					};
-				};
+				memcpy(out,repText[v],repLen[v]);
+				out += repLen[v];
+				}
+			else out += sprintf(out,"? %s at column %d",error,(int)(errorAt-line)+1);
 			};
+		*out++ = '\n';
+		start = eol+1;
 		};
-		
-done:
+	return out;
+	};
+};
+
+//	Format a formal element as printTuple does, with the monomial names from a rig file
 
-	if (c1 != c2)
+size_t formatFormal(const RigFile &rf, uint32_t formal, char *buf)
+{
+char *q = buf;
+bool needPlus = false;
+for (uint32_t k=0;k<rf.nmono;k++,formal/=rf.nvalue)
+	{
+	int c = formal % rf.nvalue;
+	if (c==0) continue;
+	if (needPlus) *q++ = '+';
+	if (k==0) q += sprintf(q,"%d",c);
+	else
 		{
-		printf("Merging classes ...\n");
+		if (c!=1) q += sprintf(q,"%d",c);
+		q += sprintf(q,"%s",rigMonomialName(rf,k));
+		};
+	needPlus = true;
+	};
+if (!needPlus) *q++ = '0';
+*q = 0;
+return q-buf;
+}
 
-		//	Merge the c2 class into the c1 class
-		
-		for (int k=0;k<LL[c2].count;k++)
+//	Read expressions from stdin and write their normal forms to stdout, in chunks of whole
+//	lines that are split between the worker threads
+
+bool normalizeStream(const char *rigPath)
+{
+RigFile rf;
+if (!rigFileOpen(rf,rigPath))
+	{
+	fprintf(stderr,"Can't load the rig file %s\n",rigPath);
+	return false;
+	};
+	
+char **repText = new char *[rf.nclasses];
+size_t *repLen = new size_t[rf.nclasses];
+size_t maxLen = 64;
+for (uint32_t c=0;c<rf.nclasses;c++)
+	{
+	char buf[RIG_NAME_LEN*16];
+	repLen[c] = formatFormal(rf,rigRepresentative(rf,c),buf);
+	repText[c] = new char[repLen[c]+1];
+	memcpy(repText[c],buf,repLen[c]+1);
+	maxLen = std::max(maxLen,repLen[c]);
+	};
+	
+char *in = new char[NORMALIZE_CHUNK+1];
+char **out = new char *[numThreads];
+size_t *outCap = new size_t[numThreads];
+char **outEnd = new char *[numThreads];
+for (int t=0;t<numThreads;t++)
+	{
+	out[t] = NULL;
+	outCap[t] = 0;
+	};
+	
+size_t carry = 0;
+bool eof = false;
+while (!eof || carry>0)
+	{
+	size_t got = eof ? 0 : fread(in+carry,1,NORMALIZE_CHUNK-carry,stdin);
+	if (got==0) eof = true;
+	size_t have = carry+got;
+	
+	//	Process up to the last newline, or everything at the end of the input
+	
+	if (eof && have>0 && in[have-1]!='\n') in[have++] = '\n';
+	size_t stop = have;
+	if (!eof)
+		{
+		while (stop>0 && in[stop-1]!='\n') stop--;
+		if (stop==0) stop = have;
+		};
+	if (stop==0) break;
+	
+	//	Split at newlines into a part per thread
+	
+	const char *partStart[65];
+	int nparts = std::min(numThreads,64);
+	partStart[0] = in;
+	for (int t=1;t<nparts;t++)
+		{
+		const char *q = in + stop*t/nparts;
+		if (q<partStart[t-1]) q = partStart[t-1];
+		while (q<in+stop && q>in && q[-1]!='\n') q++;
+		partStart[t] = q;
+		};
+	partStart[nparts] = in+stop;
+	
+	for (int t=0;t<nparts;t++)
+		{
+		size_t lines = 1;
+		for (const char *q=partStart[t];(q=(const char *)memchr(q,'\n',partStart[t+1]-q))!=NULL;q++) lines++;
+		size_t need = lines*(maxLen+64);
+		if (need>outCap[t])
 			{
-			Index z = LL[c2].elements[k];
-			LL[c1].elements[LL[c1].count++] = z;
-			eqc[z] = c1;
+			delete [] out[t];
+			out[t] = new char[need];
+			outCap[t] = need;
 			};
-			
-		countLL--;
-		
-		//	Unlink
-		
-		int prev = LL[c2].prev;
-		int next = LL[c2].next;
-		if (prev<0) firstLL = next;
-		else LL[prev].next = next;
-		if (next>=0) LL[next].prev = prev;
+		};
 		
-		delete [] LL[c2].elements;
-		LL[c2].elements = NULL;
-		LL[c2].count = 0;
-		LL[c2].prev = LL[c2].next = -1;
+	parallelBlocks(nparts,1,[&](int t, int)
+		{
+		Normalizer nz;
+		nz.rf = &rf;
+		outEnd[t] = nz.normalizeLines(partStart[t],partStart[t+1],out[t],repText,repLen);
+		});
+	for (int t=0;t<nparts;t++) fwrite(out[t],1,outEnd[t]-out[t],stdout);
+	
+	carry = have-stop;
+	memmove(in,in+stop,carry);
+	};
+fflush(stdout);
 
-		didMerge = true;
-		
-		FILE *fp=fopen(OUTPUT_FILE,"wt");
-		if (fp==NULL)
-			{
-			printf("Error opening output file %s to write\n",OUTPUT_FILE);
-			printf("Sending output to console:\n");
-			outputEC(stdout);
-			}
-		else
+for (int t=0;t<numThreads;t++) delete [] out[t];
+delete [] outEnd;
+delete [] outCap;
+delete [] out;
+delete [] in;
+for (uint32_t c=0;c<rf.nclasses;c++) delete [] repText[c];
+delete [] repLen;
+delete [] repText;
+rigFileClose(rf);
+return true;
+}
+
+int main(int argc, const char * argv[])
+{
+//	Parse the command line
+
+numThreads = std::max(1,(int)std::thread::hardware_concurrency());
+bool useRestart = false;
+bool useSweep = false;
+CheckMode checkMode = CHECK_FULL;
+int maxPasses = INT_MAX;
+bool testChecks = false;
+bool testUF = false;
+bool seedSums = false;
+const char *normalizePath = NULL;
+bool testArith = false;
+bool benchMult = false;
+const char *cachePath = TABLE_CACHE_FILE;
+bool resume = false;
+const char *monoidPath = NULL;
+bool deriveCoeffs = false, coeffsGiven = false;
+bool useSparse = false;
+for (int i=1;i<argc;i++)
+	{
+	if (strcmp(argv[i],"--legacy")==0) useRestart = true;
+	else if (strcmp(argv[i],"--check=full")==0)
+		{
+		useRestart = true;
+		checkMode = CHECK_FULL;
+		}
+	else if (strcmp(argv[i],"--check=rep")==0)
+		{
+		useRestart = true;
+		checkMode = CHECK_REP;
+		}
+	else if (strcmp(argv[i],"--check=gen")==0)
+		{
+		useRestart = true;
+		checkMode = CHECK_GEN;
+		}
+	else if (strcmp(argv[i],"--sweep")==0) useSweep = true;
+	else if (strcmp(argv[i],"--symmetry")==0) useSymmetry = true;
+	else if (strcmp(argv[i],"--seed-sums")==0) seedSums = true;
+	else if (strcmp(argv[i],"--normalize")==0) normalizePath = RIG_FILE;
+	else if (strncmp(argv[i],"--normalize=",12)==0) normalizePath = argv[i]+12;
+	else if (strncmp(argv[i],"--fingerprint=",14)==0) fingerprintSamples = std::max(0,atoi(argv[i]+14));
+	else if (strcmp(argv[i],"--test-checks")==0) testChecks = true;
+	else if (strcmp(argv[i],"--test-arith")==0) testArith = true;
+	else if (strcmp(argv[i],"--test-uf")==0) testUF = true;
+	else if (strcmp(argv[i],"--no-mtab")==0) haveMTAB = false;
+	else if (strcmp(argv[i],"--bench-mult")==0) benchMult = true;
+	else if (strncmp(argv[i],"--threads=",10)==0) numThreads = std::max(1,atoi(argv[i]+10));
+	else if (strncmp(argv[i],"--table-cache=",14)==0) cachePath = argv[i]+14;
+	else if (strcmp(argv[i],"--no-table-cache")==0) cachePath = NULL;
+	else if (strcmp(argv[i],"--resume")==0) resume = true;
+	else if (strncmp(argv[i],"--snapshot-interval=",20)==0) snapshotInterval = atof(argv[i]+20);
+	else if (strncmp(argv[i],"--checkpoint=",13)==0) checkpointPath = argv[i]+13;
+	else if (strncmp(argv[i],"--checkpoint-interval=",22)==0) checkpointInterval = atof(argv[i]+22);
+	else if (strncmp(argv[i],"--max-passes=",13)==0) maxPasses = atoi(argv[i]+13);
+	else if (strncmp(argv[i],"--monoid=",9)==0) monoidPath = argv[i]+9;
+	else if (strncmp(argv[i],"--coeffs=",9)==0)
+		{
+		if (sscanf(argv[i]+9,"%d,%d",&coeffK,&coeffP)!=2 || coeffK<0 || coeffP<1
+			|| coeffK+coeffP<2 || coeffK+coeffP>MAXINDEX)
 			{
-			outputEC(fp);
-			fclose(fp);
+			printf("Bad coefficient rule %s: need K >= 0, P >= 1 and K+P >= 2\n",argv[i]+9);
+			exit(EXIT_FAILURE);
 			};
+		coeffsGiven = true;
+		}
+	else if (strcmp(argv[i],"--derive-coeffs")==0) deriveCoeffs = true;
+	else if (strcmp(argv[i],"--sparse")==0) useSparse = true;
+	else if (strcmp(argv[i],"--validate")==0) fullValidation = true;
+	else if (strncmp(argv[i],"--max-elements=",15)==0) sparseMaxElements = (uint32_t)std::max(1L,std::min(atol(argv[i]+15),(long)UINT32_MAX-1));
+	else
+		{
+		printf("Unknown option %s\n",argv[i]);
+		printf("Usage: %s [--legacy] [--check=full|rep|gen] [--symmetry] [--sweep] [--seed-sums]\n"
+			"       [--fingerprint=N] [--max-passes=N] [--test-checks] [--test-arith] [--test-uf]\n"
+			"       [--no-mtab] [--bench-mult] [--threads=N] [--table-cache=FILE] [--no-table-cache]\n"
+			"       [--resume] [--checkpoint=FILE] [--checkpoint-interval=S] [--snapshot-interval=S]\n"
+			"       [--monoid=FILE] [--coeffs=K,P] [--derive-coeffs] [--sparse] [--max-elements=N]\n"
+			"       [--validate] [--normalize[=RIGFILE]]\n",argv[0]);
+		printf("  --legacy         use the original closure loop, which restarts after every merge\n");
+		printf("  --check=MODE     use the restart loop with the given check: full (the original\n");
+		printf("                   check of all x1~x2, y1~y2, same as --legacy), rep (each element\n");
+		printf("                   against its class representative) or gen (the same, but only\n");
+		printf("                   for the generating unary maps)\n");
+		printf("  --symmetry       keep the classes invariant under the symmetries of the monomials,\n");
+		printf("                   and check one class from each orbit in the restart loop; not with\n");
+		printf("                   the sparse engine\n");
+		printf("  --sweep          merge all the classes that signatures show must be merged in each\n");
+		printf("                   sweep, rather than one pair per pass\n");
+		printf("  --seed-sums      merge x+y with x+xy+yx+y for all pairs before the closure\n");
+		printf("  --fingerprint=N  in the restart loop, look for mismatches with fingerprints of N\n");
+		printf("                   random products and sums first, and only make the chosen check\n");
+		printf("                   when they find nothing\n");
+		printf("  --max-passes=N   stop the restart loop after N merges, or the sweep loop after N sweeps\n");
+		printf("  --test-checks    test that the checks agree, instead of running the closure\n");
+		printf("  --test-arith     test the fast arithmetic exhaustively, instead of running the closure\n");
+		printf("  --test-uf        stress test the concurrent union-find, instead of running the closure\n");
+		printf("  --no-mtab        don't build the multiplication table, compute products as needed,\n");
+		printf("                   or whole rows and columns for the union-find closure\n");
+		printf("  --bench-mult     compare the speed of MTAB lookups and computed products\n");
+		printf("  --threads=N      number of worker threads (default: all available cores)\n");
+		printf("  --table-cache=F  map MTAB from the cache file F, or save it there once built\n");
+		printf("                   (default %s)\n",TABLE_CACHE_FILE);
+		printf("  --no-table-cache always build MTAB in memory\n");
+		printf("  --resume         carry on the closure from the last checkpoint\n");
+		printf("  --checkpoint=F   checkpoint file (default %s)\n",CHECKPOINT_FILE);
+		printf("  --checkpoint-interval=S\n");
+		printf("                   seconds between checkpoints, 0 for none (default 60)\n");
+		printf("  --snapshot-interval=S\n");
+		printf("                   minimum seconds between snapshots of the classes written to\n");
+		printf("                   %s during the closure, 0 for none (default 10)\n",OUTPUT_FILE);
+		printf("  --monoid=F       use the monoid of monomials in the text file F, or the built-in\n");
+		printf("                   monoid band2, semilattice2 or leftregular2, rather than the\n");
+		printf("                   free idempotent monoid on two generators (band2)\n");
+		printf("  --coeffs=K,P     coefficients are the natural numbers with c = c-P for c >= K+P\n");
+		printf("                   (default 2,2: 4 = 2, 5 = 3, ...; 1,1 is Boolean, 1,2 has 3 = 1)\n");
+		printf("  --derive-coeffs  report the rule for the integers that the closure arrives at,\n");
+		printf("                   starting from --coeffs (default 4,2, coefficients 0 .. 5)\n");
+		printf("  --sparse         use the sparse engine, which only stores the elements it reaches;\n");
+		printf("                   monoids of more than %d monomials always use it\n",MAXMONO);
+		printf("  --max-elements=N stop the sparse engine once it has stored N elements (default %u,\n",SPARSE_MAX_NODES);
+		printf("                   or fewer if they would need more than %zu MB)\n",SPARSE_MAX_BYTES >> 20);
+		printf("  --validate       check the rig laws on every triple of classes of the quotient,\n");
+		printf("                   rather than on random triples when there are more than %d\n",VALIDATE_ALL_CLASSES);
+		printf("  --normalize[=F]  read expressions from stdin, one per line, and write the\n");
+		printf("                   representatives of their elements to stdout, using the rig\n");
+		printf("                   file F written by an earlier run (default %s)\n",RIG_FILE);
+		exit(EXIT_FAILURE);
 		};
-	
-	if (!didMerge) break;
-	passCount++;
 	};
 
-printf("We now have %d equivalence classes:\n",countLL);
+if (normalizePath!=NULL) return normalizeStream(normalizePath) ? 0 : EXIT_FAILURE;
+
+//	Set up the monoid, and everything whose size depends on it
+
+if (deriveCoeffs && !coeffsGiven) coeffK = 4;
+const BuiltinMonoid *builtin = findBuiltinMonoid(monoidPath==NULL ? "band2" : monoidPath);
+if (builtin!=NULL) setupBuiltinMonoid(*builtin);
+else if (!loadMonoid(monoidPath)) return EXIT_FAILURE;
+nvalue = coeffK+coeffP;
+twoBitCoeffs = (coeffK==2 && coeffP==2);
+bool dense = nmono<=MAXMONO;
+nindex = 1;
+for (int m=0;m<nmono && dense;m++)
+	{
+	monoIndex[m] = (Index)nindex;
+	if ((int64_t)nindex*nvalue > MAXINDEX) dense = false;
+	else nindex *= nvalue;
+	};
+if (!dense && !useSparse)
+	{
+	printf("%d coefficient values for %d monomials give more than %d formal elements, so the sparse engine will be used\n\n",
+		nvalue,nmono,MAXINDEX);
+	useSparse = true;
+	};
+if (useSparse && nvalue>SPARSE_MAX_VALUES)
+	{
+	printf("The sparse engine allows at most %d coefficient values\n",SPARSE_MAX_VALUES);
+	return EXIT_FAILURE;
+	};
+if (useSymmetry && useSparse)
+	{
+	printf("--symmetry is not supported by the sparse engine\n");
+	return EXIT_FAILURE;
+	};
+if (!twoBitCoeffs) printf("Coefficients 0 .. %d, with %d = %d\n\n",nvalue-1,nvalue,coeffK);
+if (!useSparse)
+	{
+	setupAddTables();
+	if (haveMTAB && (size_t)nindex*nindex*sizeof(Index) > MAX_MTAB_BYTES)
+		{
+		printf("MTAB would need %.1f GB, so products will be computed as needed\n\n",
+			(double)nindex*nindex*sizeof(Index)/(1<<30));
+		haveMTAB = false;
+		};
+	classes.allocate();
+	};
+
+//	Print the monomial multiplication table
+
+printf("Monomial multiplication table\n     ");
+for (int i=0;i<nmono;i++) printf("%5s",mtext[i]);
+printf("\n     ");
+for (int i=0;i<nmono;i++) printf("  ===");
+printf("\n");
+for (int i=0;i<nmono;i++)
+	{
+	printf("%4s|",mtext[i]);
+	for (int j=0;j<nmono;j++) printf("%5s",mtext[mtab[i][j]]);
+	printf("\n");
+	};
+printf("\n");
+
+if (useSparse) return sparseClosure(deriveCoeffs) ? 0 : EXIT_FAILURE;
+
+printf("Checking indexToTuple/tupleToIndex ...\n");
+int tup[MAXMONO];
+for (int k=0;k<nindex;k++)
+	{
+	indexToTuple(k,tup);
+	if (k!=tupleToIndex(tup))
+		{
+		printf("indexToTuple/tupleToIndex failure for index=%d\n",k);
+		break;
+		};
+	};
+printf("Done\n\n");
+
+printf("First few sums ...\n");
+for (int k=0;k<std::min(20,nindex);k++)
+	{
+	printIndex(stdout,k,false);
+	printf("\n");
+	};
+printf("\n\n");
+
+//	Test multiplication
+
+int aplusb[MAXMONO] = {0};	//	a+b, or the sum of the first two monomials after 1
+for (int i=1;i<std::min(3,nmono);i++) aplusb[i] = 1;
+int aplusb2[MAXMONO];
+multTuples(aplusb,aplusb,aplusb2);
+printf("Test multiplication\n");
+printTuple(stdout,aplusb,true);
+printf("^2 = ");
+printTuple(stdout,aplusb2,false);
+printf("\n\n");
+
+if (testUF) return testConcurrentUF() ? 0 : EXIT_FAILURE;
+
+//	Set up the multiplication table; addition is computed directly by addIndices, and
+//	without MTAB multiplication is computed by multIndices
+
+setupMonomialActions();
+selectKernels();
+
+if (haveMTAB && (cachePath==NULL || !mapMultTable(cachePath)))
+	{
+	buildMultTable();
+	if (cachePath!=NULL) saveMultTable(cachePath);
+	};
+
+if (testArith) return testArithmetic() ? 0 : EXIT_FAILURE;
+if (benchMult) benchMultiplication();
+
+setupUnaryMaps();
+if (useSymmetry)
+	{
+	setupSymmetries();
+	if (!testSymmetries()) return EXIT_FAILURE;
+	};
+
+//	Start from the classes of elements with the same square, or from a checkpoint
+
+bool resumedWorklist = false;
+if (!resume || !loadCheckpoint(ufPendA,ufPendB,ufPendCount,resumedWorklist))
+	{
+	seedFromSquares();
+	if (seedSums) seedFromSums();
+	};
+
+//	Revalidate all equivalence class info
+
+printf("Validating equivalence class info ...\n");
+if (!classes.validate())
+	{
+	printf("Failed\n");
+	exit(EXIT_FAILURE);
+	};
+printf("Done, total elements checked = %d\n\n",classes.offset[classes.count]);
+
+if (testChecks)
+	{
+	bool ok = testCheckEquivalence();
+	return ok ? 0 : EXIT_FAILURE;
+	};
+
+double tClosure = wallSeconds();
+lastCheckpoint = tClosure;
+startSnapshots();
+if (useSweep) sweepClosure(maxPasses);
+else if (useRestart) restartClosure(checkMode,maxPasses);
+else ufClosure(resumedWorklist);
+stopSnapshots();
+printf("Closure took %.3f s\n",wallSeconds()-tClosure);
+bool derived = !deriveCoeffs || deriveCoeffRule();
+
+writeOutput(classes);
+
+//	The addition and multiplication tables of the quotient
+
+Quotient quotient;
+double tQuotient = wallSeconds();
+buildQuotient(classes,quotient);
+bool valid = validateQuotient(quotient,classes.eqc);
+printf("Quotient tables built and checked in %.3f s: %s\n",wallSeconds()-tQuotient,
+	valid ? "all the rig axioms and x*x = x hold" : "FAILED");
+if (valid)
+	{
+	writeQuotient(quotient);
+	if (writeRigFile(quotient,classes.eqc)) printf("Wrote the rig file %s\n",RIG_FILE);
+	};
+freeQuotient(quotient);
+
+printf("We now have %d equivalence classes, after %" PRIu64 " table lookups\n",classes.count,tableLookups);
 
-return 0;
+return derived ? 0 : EXIT_FAILURE;
 }
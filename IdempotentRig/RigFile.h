@@ -0,0 +1,253 @@
+//
+//  RigFile.h
+//  IdempotentRig
+//
+/*
+
+The binary "rig file" written by IdempotentRig, and a loader for it.
+
+The file is meant to be mapped and used directly, with no parsing.  It holds, in native byte
+order, a header followed by sections at 64-byte aligned offsets:
+
+	mtab	nmono x nmono uint16_t, the monomial multiplication table
+	names	nmono names of the monomials, RIG_NAME_LEN chars each, NUL-terminated
+	eqc		nindex uint16_t, the element of the rig (numbered from 0) for every formal element
+	rep		nclasses uint16_t, the representative (smallest formal element) of each element
+	add		nclasses x nclasses uint16_t, the addition table of the rig
+	mul		nclasses x nclasses uint16_t, the multiplication table of the rig
+
+A formal element is a sum of monomials with coefficients from 0 to nvalue-1, encoded as the
+integer with the coefficient of monomial i as its digit i in base nvalue, so nindex =
+nvalue^nmono.  Monomial 0 is the identity.  Larger coefficients reduce by the rule in the
+header: c = c-coeffP once c-coeffP >= coeffK, and nvalue = coeffK+coeffP.  The usual rule
+4 = 2, 5 = 3, 6 = 2, ... has coeffK = coeffP = 2, and then each coefficient is 2 bits.
+
+Usage:
+
+	RigFile rf;
+	if (rigFileOpen(rf,"IdempotentRig.rig"))
+		{
+		uint16_t x = rigNormalize(rf,formal);
+		uint16_t y = rigMul(rf,x,rigMonomial(rf,1));
+		...
+		rigFileClose(rf);
+		};
+
+*/
+
+#ifndef RigFile_h
+#define RigFile_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RIG_FILE_MAGIC "IRigFILE"
+#define RIG_FILE_VERSION 2
+#define RIG_NAME_LEN 16
+#define RIG_FILE_MAXMONO 8
+
+struct RigFileHeader
+{
+char magic[8];
+uint32_t version;
+uint32_t nmono;
+uint32_t nindex;
+uint32_t nclasses;
+uint32_t coeffK;
+uint32_t coeffP;
+uint64_t mtabOffset;
+uint64_t nameOffset;
+uint64_t eqcOffset;
+uint64_t repOffset;
+uint64_t addOffset;
+uint64_t mulOffset;
+uint64_t size;
+};
+
+//	A mapped rig file, with pointers to its sections
+
+struct RigFile
+{
+void *base;
+size_t size;
+const RigFileHeader *header;
+const uint16_t *mtab;
+const char *names;
+const uint16_t *eqc;
+const uint16_t *rep;
+const uint16_t *add;
+const uint16_t *mul;
+uint32_t nmono;
+uint32_t nindex;
+uint32_t nclasses;
+uint32_t coeffK;
+uint32_t coeffP;
+uint32_t nvalue;
+};
+
+//	The number of formal elements for the given sizes, or 0 if there are more than 2^16
+
+inline uint32_t rigFileIndices(uint32_t nmono, uint32_t nvalue)
+{
+uint64_t n = 1;
+for (uint32_t i=0;i<nmono && n<=65536;i++) n *= nvalue;
+return n<=65536 ? (uint32_t)n : 0;
+}
+
+//	Offsets of the sections in a file for the given sizes, filling in all of the header but
+//	the magic string and version
+
+inline void rigFileLayout(RigFileHeader &h, uint32_t nmono, uint32_t coeffK, uint32_t coeffP, uint32_t nclasses)
+{
+uint64_t at = (sizeof(RigFileHeader)+63) & ~(uint64_t)63;
+h.nmono = nmono;
+h.nindex = rigFileIndices(nmono,coeffK+coeffP);
+h.nclasses = nclasses;
+h.coeffK = coeffK;
+h.coeffP = coeffP;
+h.mtabOffset = at;	at += ((uint64_t)nmono*nmono*2+63) & ~(uint64_t)63;
+h.nameOffset = at;	at += ((uint64_t)nmono*RIG_NAME_LEN+63) & ~(uint64_t)63;
+h.eqcOffset = at;	at += ((uint64_t)h.nindex*2+63) & ~(uint64_t)63;
+h.repOffset = at;	at += ((uint64_t)nclasses*2+63) & ~(uint64_t)63;
+h.addOffset = at;	at += ((uint64_t)nclasses*nclasses*2+63) & ~(uint64_t)63;
+h.mulOffset = at;	at += ((uint64_t)nclasses*nclasses*2+63) & ~(uint64_t)63;
+h.size = at;
+}
+
+inline void rigFileClose(RigFile &rf)
+{
+if (rf.base!=NULL) munmap(rf.base,rf.size);
+rf.base = NULL;
+}
+
+//	Check that every entry of a table is below n
+
+inline bool rigFileBelow(const uint16_t *t, uint64_t count, uint32_t n)
+{
+for (uint64_t i=0;i<count;i++) if (t[i]>=n) return false;
+return true;
+}
+
+//	Map a rig file read-only, returning false if it can't be opened or is not a valid rig file
+//	of this version.  Every table entry is checked to be in range, and every name to be
+//	terminated, so that the lookups below can trust the file.
+
+inline bool rigFileOpen(RigFile &rf, const char *path)
+{
+rf.base = NULL;
+int fd = open(path,O_RDONLY);
+if (fd<0) return false;
+struct stat st;
+if (fstat(fd,&st)!=0 || (size_t)st.st_size < sizeof(RigFileHeader))
+	{
+	close(fd);
+	return false;
+	};
+rf.size = (size_t)st.st_size;
+void *base = mmap(NULL,rf.size,PROT_READ,MAP_SHARED,fd,0);
+close(fd);
+if (base==MAP_FAILED) return false;
+rf.base = base;
+
+const RigFileHeader *h = (const RigFileHeader *)base;
+RigFileHeader expect;
+bool ok = memcmp(h->magic,RIG_FILE_MAGIC,8)==0 && h->version==RIG_FILE_VERSION
+	&& h->nmono>=1 && h->nmono<=RIG_FILE_MAXMONO && h->coeffP>=1 && h->coeffK<=65536 && h->coeffP<=65536
+	&& h->coeffK+h->coeffP>=2 && rigFileIndices(h->nmono,h->coeffK+h->coeffP)!=0
+	&& h->nclasses>=1 && h->nclasses<=rigFileIndices(h->nmono,h->coeffK+h->coeffP);
+if (ok)
+	{
+	rigFileLayout(expect,h->nmono,h->coeffK,h->coeffP,h->nclasses);
+	ok = h->nindex==expect.nindex && h->mtabOffset==expect.mtabOffset && h->nameOffset==expect.nameOffset
+		&& h->eqcOffset==expect.eqcOffset && h->repOffset==expect.repOffset
+		&& h->addOffset==expect.addOffset && h->mulOffset==expect.mulOffset
+		&& h->size==expect.size && h->size==rf.size;
+	};
+const char *b = (const char *)base;
+if (ok)
+	{
+	uint64_t nc = h->nclasses;
+	ok = rigFileBelow((const uint16_t *)(b+h->mtabOffset),(uint64_t)h->nmono*h->nmono,h->nmono)
+		&& rigFileBelow((const uint16_t *)(b+h->eqcOffset),h->nindex,h->nclasses)
+		&& rigFileBelow((const uint16_t *)(b+h->repOffset),nc,h->nindex)
+		&& rigFileBelow((const uint16_t *)(b+h->addOffset),nc*nc,h->nclasses)
+		&& rigFileBelow((const uint16_t *)(b+h->mulOffset),nc*nc,h->nclasses);
+	for (uint32_t m=0;ok && m<h->nmono;m++)
+		ok = memchr(b+h->nameOffset+m*RIG_NAME_LEN,0,RIG_NAME_LEN)!=NULL;
+	};
+if (!ok)
+	{
+	rigFileClose(rf);
+	return false;
+	};
+
+rf.header = h;
+rf.mtab = (const uint16_t *)(b+h->mtabOffset);
+rf.names = b+h->nameOffset;
+rf.eqc = (const uint16_t *)(b+h->eqcOffset);
+rf.rep = (const uint16_t *)(b+h->repOffset);
+rf.add = (const uint16_t *)(b+h->addOffset);
+rf.mul = (const uint16_t *)(b+h->mulOffset);
+rf.nmono = h->nmono;
+rf.nindex = h->nindex;
+rf.nclasses = h->nclasses;
+rf.coeffK = h->coeffK;
+rf.coeffP = h->coeffP;
+rf.nvalue = h->coeffK+h->coeffP;
+return true;
+}
+
+//	The element of the rig for a formal element, and the rig operations on elements
+
+inline uint16_t rigNormalize(const RigFile &rf, uint32_t formal)
+{
+return rf.eqc[formal];
+}
+
+inline uint16_t rigAdd(const RigFile &rf, uint16_t x, uint16_t y)
+{
+return rf.add[(uint32_t)x*rf.nclasses+y];
+}
+
+inline uint16_t rigMul(const RigFile &rf, uint16_t x, uint16_t y)
+{
+return rf.mul[(uint32_t)x*rf.nclasses+y];
+}
+
+//	Reduce a coefficient by the rule of the file
+
+inline uint32_t rigCoeff(const RigFile &rf, uint32_t n)
+{
+return n<rf.nvalue ? n : rf.coeffK+(n-rf.coeffK)%rf.coeffP;
+}
+
+//	The element for monomial m, for the integer n, and the representative of element x
+
+inline uint16_t rigMonomial(const RigFile &rf, uint32_t m)
+{
+uint32_t x = 1;
+for (uint32_t i=0;i<m;i++) x *= rf.nvalue;
+return rf.eqc[x];
+}
+
+inline uint16_t rigInteger(const RigFile &rf, uint32_t n)
+{
+return rf.eqc[rigCoeff(rf,n)];
+}
+
+inline uint32_t rigRepresentative(const RigFile &rf, uint16_t x)
+{
+return rf.rep[x];
+}
+
+inline const char *rigMonomialName(const RigFile &rf, uint32_t m)
+{
+return rf.names+m*RIG_NAME_LEN;
+}
+
+#endif